@@ -0,0 +1,48 @@
+/*
+ * arena.h
+ *
+ * One allocation for a group of structures that live and die together, e.g.
+ * everything in a simulated hierarchy: the size is worked out first, each
+ * structure is then carved off in turn, aligned to a cache line and zeroed,
+ * and freeing the arena frees the lot. So structures allocated one after
+ * another sit next to each other in memory, and setting up and tearing down
+ * is a single allocation and a single free however many structures there are.
+ * Memory is only zeroed (and only takes space) when first touched, so large
+ * structures that start all zero, like tag arrays, cost nothing to set up.
+ *
+ */
+
+#ifndef arena_h
+#define arena_h
+
+#include <stddef.h>
+
+typedef struct Arena ArenaT;
+
+// alignment of everything allocated from an arena
+#define ARENAALIGN 64
+
+// space bytes take in an arena: add these up to size one
+size_t arenabytes (size_t bytes);
+
+// an arena with room for bytes (as added up with arenabytes); more than the
+// limit is an error
+ArenaT *initarena (size_t bytes);
+
+// most bytes an arena may have, e.g. so a mistyped cache size stops the
+// simulator rather than the machine: 0 (the default) for no limit
+void setarenalimit (size_t bytes);
+
+// bytes from the arena, aligned and zeroed; running out is an error, as the
+// arena should have been sized for everything allocated from it
+void *arenaalloc (ArenaT *arena, size_t bytes);
+
+// zero bytes allocated from an arena, to reuse them as new: big ranges are
+// handed back to the OS, to be zeroed again only if touched
+void arenazero (void *memory, size_t bytes);
+
+// free the arena and everything allocated from it -- pass in pointer so we can
+// set it NULL
+void deconstruct_arena (ArenaT **arena);
+
+#endif // arena_h
@@ -15,27 +15,71 @@
 
 #include "generaltypes.h"
 #include "rawcache.h"
+#include "arena.h"
+#include "report.h"
 
 typedef struct CacheSetup CacheSetupT;
 
-// add a new set of cache parameters to the list: because of realloc, should
-// assign the result back to the original data structure; inserts the given
-// pointer and does not copy so it should not be freed outside of managing this
-// data structure
-CacheSetupT **addCacheParameters (CacheSetupT* allparemeters[], CacheSetupT *newone);
+// multilevel inclusion policy: applies to the whole hierarchy so, as with
+// split, only the setting on the first (L1) line is used
+//   inclusive    -- every level holds a copy of everything above it; evicting
+//                   from a lower level back-invalidates upper levels
+//   noninclusive -- non-inclusive non-exclusive (NINE): fill as inclusive but
+//                   never back-invalidate
+//   exclusive    -- a block lives in one level only: misses fill L1 and lower
+//                   levels are filled only with victims from the level above
+typedef enum {inclusive, noninclusive, exclusive} InclusionT;
 
+// requests to a sliced level over which contention for a slice is counted
+#define DEFAULTSLICEWINDOW 8
+
+// replacement choices start from this unless a seed is given
+#define DEFAULTSEED 1
+
+// first-level TLBs for instructions and data, and a second-level TLB shared
+// by both
+typedef enum {ITLB, DTLB, STLB} TLBkindT;
+
+#define NTLBKINDS 3
+
+typedef unsigned PagesizeT;
+
+// parameters allocated from arena, which holds all of a configuration's (see
+// getconfig)
 CacheSetupT *makeCacheParameters (CachesizeT totalblocks,
     BlocksizeT blocksize,
     LatencyT hittime, LatencyT missoverhead,
-    CacheAssociativityT associativity, bool split);
-
-CacheSetupT *makeCacheParametersStr (char *line);
+    CacheAssociativityT associativity, bool split, ArenaT *arena);
+
+// a configuration line: the six numbers described in the usage message,
+// optionally followed by whitespace-separated options in the form name=value:
+//   inclusion=inclusive|noninclusive|exclusive
+//   index=mask|xor|mod|skew (see IndexfunctionT)
+//   slices=N split the level into N slices, each with all the ways, a block's
+//     slice chosen by hashing its address
+//   slicewindow=W a request waits a hit time for each of the last W requests
+//     to the level that went to the same slice (default DEFAULTSLICEWINDOW):
+//     reported as queueing delay apart from elapsed time
+//   filterout=file simulate L1 only, writing its misses and the blocks leaving
+//     it to file as a delta trace (see deltatrace.h) for runs with prefiltered=1
+//   prefiltered=0|1 the trace is such an L1 miss stream: simulate the levels
+//     below L1, with L1 only counting misses
+//   seed=N random replacement choices follow from N (default DEFAULTSEED)
+// (as with inclusion, filterout, prefiltered and seed only apply on the first line)
+// a line "victim <blocks> <hit time>" instead attaches a fully-associative
+// victim cache to the level on the line before, and a line
+// "tlb I|D|S <entries> <associativity> <hit time> [page=4K|2M|1G]" adds a TLB
+// to the hierarchy (both handled by getconfig)
+CacheSetupT *makeCacheParametersStr (char *line, ArenaT *arena);
 
 void checkparameters (CacheSetupT * caches []);
 
+// the parameters of each cache line, NULL terminated; the array, parameters and
+// their strings are all in one arena
 CacheSetupT** getconfig (char **configlines);
 
-// deallocate an array of cache parameters including the outer level
+// deallocate an array of cache parameters including the outer level: a single
+// free of their arena
 void deconstruct_setup (CacheSetupT * caches []);
 
 // display paraemters in neat format for reporting
@@ -43,6 +87,10 @@ void deconstruct_setup (CacheSetupT * caches []);
 // block count as well as total bytes
 void reportParameters (CacheSetupT* allparemeters[]);
 
+// the same for a machine-readable report: every parameter of each level (as
+// unit L1, L1I...), DRAM, each TLB and the hierarchy as a whole
+void reportParametersTo (CacheSetupT* allparemeters[], ReportT *report);
+
 
 int parameterlen (CacheSetupT* allparemeters[]);
 
@@ -58,5 +106,39 @@ CacheAssociativityT getSetupAssociativity (CacheSetupT *setup);
 
 bool getSetupSplit (CacheSetupT *setup);
 
+InclusionT getSetupInclusion (CacheSetupT *setup);
+
+// 0 if no victim cache is attached to this level
+CachesizeT getSetupVictimblocks (CacheSetupT *setup);
+
+LatencyT getSetupVictimhittime (CacheSetupT *setup);
+
+IndexfunctionT getSetupIndexfunction (CacheSetupT *setup);
+
+// 1 if not sliced
+unsigned getSetupSlices (CacheSetupT *setup);
+
+unsigned getSetupSlicewindow (CacheSetupT *setup);
+
+// TLBs are only held in the first level's parameters; 0 entries if absent
+CachesizeT getSetupTLBentries (CacheSetupT *setup, TLBkindT which);
+
+CacheAssociativityT getSetupTLBassociativity (CacheSetupT *setup, TLBkindT which);
+
+LatencyT getSetupTLBhittime (CacheSetupT *setup, TLBkindT which);
+
+PagesizeT getSetupPagesize (CacheSetupT *setup);
+
+// L1 filtering is only set in the first level's parameters; NULL if not filtering
+char *getSetupFilterout (CacheSetupT *setup);
+
+bool getSetupPrefiltered (CacheSetupT *setup);
+
+// only in the first level's parameters
+unsigned long getSetupSeed (CacheSetupT *setup);
+
+// replace the seed of the configuration file, e.g. from the command line
+void setSetupSeed (CacheSetupT *setup, unsigned long seed);
+
 
 #endif // cachesetup_h
@@ -0,0 +1,58 @@
+/*
+ * configfile.h
+ *
+ * A configuration file in either format, and the sweep of configurations it
+ * describes. Besides the usual lines of numbers (see cachesetup.h), a file
+ * may be a list of settings, INI style:
+ *   [l1d]             -- a section: l1 (unified), l1i and l1d, l2, l3...,
+ *   size=32K             dram, itlb, dtlb, stlb, or hierarchy
+ *   assoc=8           -- a setting of the section above
+ *   l3.size=4M        -- the same with the section spelled out, anywhere
+ *   seed=3            -- before any section: a hierarchy setting
+ * with # or ; starting a comment line. Numbers may end in K, M or G (times
+ * 1024 each). The settings are
+ *   levels:    size, block, hit (all needed), lookup (default 0), assoc
+ *              (default 1), index, slices, slicewindow (as the options of the
+ *              usual format), victim (blocks) and victimhit, and replacement,
+ *              write and prefetch, which only take the policies simulated:
+ *              random, writeback and none
+ *   dram:      hit
+ *   TLBs:      entries, assoc (both needed), hit, page
+ *   hierarchy: inclusion, seed, filterout, prefiltered
+ * A value may instead be a sweep: a list a,b,c or a range of numbers
+ * first..last*factor or first..last+step, e.g. l3.size=1M..64M*2. The file
+ * then describes a configuration for every combination of swept values,
+ * each a point of the sweep, the last setting swept varying fastest. Each
+ * point is turned into the usual lines of numbers, so the rest of the
+ * simulator only sees that format.
+ *
+ */
+
+#ifndef configfile_h
+#define configfile_h
+
+#include <stdbool.h>
+
+typedef struct Configsweep ConfigsweepT;
+
+// most points a sweep may have
+#define MAXSWEEPPOINTS 65536
+
+// the configurations in configuration lines (as from linify) in either format:
+// one unless a list of settings sweeps some; the lines are copied
+ConfigsweepT *initsweep (char **configlines);
+
+int sweeppoints (ConfigsweepT *sweep);
+
+// the configuration at a point as lines in the usual format, for getconfig:
+// dispose of them with dispose_lines (stringutils.h)
+char **sweepconfig (ConfigsweepT *sweep, int point);
+
+// the i-th setting swept (from 0), with its value at a point: false if there
+// are no more
+bool sweepsetting (ConfigsweepT *sweep, int point, int i,
+                   const char **name, const char **value);
+
+void deconstruct_sweep (ConfigsweepT **sweep);
+
+#endif // configfile_h
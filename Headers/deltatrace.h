@@ -0,0 +1,59 @@
+/*
+ * deltatrace.h
+ *
+ * Compact binary trace format: each record is the difference from the last
+ * address of the same type of reference, so each type is a separate delta
+ * stream, zigzag encoded (small negative numbers are small too) as varints
+ * (7 bits a byte, low bits first, top bit set if more bytes follow).
+ * Consecutive references of the same type with a constant stride collapse
+ * into one run record. After the 4-byte magic number DELTAMAGIC each record is
+ *   head   -- varint: zigzag (delta) << 4 | run << 3 | type
+ *   count  -- varint, runs only: number of references in the run
+ *   stride -- zigzag varint, runs only: difference between addresses in the run
+ * where type indexes DELTATYPES and delta is from the last address of that
+ * type (the last of its run, if a run) to the first of this record. For X,
+ * not an address, the delta is from 0. A run with count 0 ends the trace.
+ *
+ */
+
+#ifndef deltatrace_h
+#define deltatrace_h
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "readtrace.h"
+
+// first bytes of a delta trace file
+#define DELTAMAGIC "\xC5" "DT1"
+#define DELTAMAGICLENGTH 4
+
+// most bytes a record can take
+#define MAXDELTARECORD 20
+
+typedef struct DeltaEncoder DeltaEncoderT;
+typedef struct DeltaDecoder DeltaDecoderT;
+
+// start writing a delta trace to a file, with the magic number
+DeltaEncoderT* initdeltaencoder (FILE *file);
+
+// add a record; references that continue a run are held until the run ends
+void deltaencode (DeltaEncoderT *encoder, Trace record);
+
+// write any record held, the end of trace and deallocate: does not close the file
+void finishdeltaencoder (DeltaEncoderT **encoder);
+
+DeltaDecoderT* initdeltadecoder ();
+
+void deconstruct_deltadecoder (DeltaDecoderT **decoder);
+
+// deltadecode's results other than a number of bytes
+#define DELTAEND     (-1) // the end of trace record
+#define DELTACORRUPT (-2) // a bad type, count or varint
+
+// decode a record from length bytes: the number of bytes used, 0 if the record
+// is not all there, DELTAEND at the end of the trace or DELTACORRUPT
+int deltadecode (DeltaDecoderT *decoder, const unsigned char *bytes, size_t length,
+                 Trace *record);
+
+#endif // deltatrace_h
@@ -17,10 +17,12 @@
 #define error_h
 
 #include <stdbool.h>
+#include <setjmp.h>
 
 enum ErrorCodes {badblockcount, badcachesize, badblockindex, badCacheID, badAssociativity,
                  associativityError, configError, configFileError, workloadError,
-                 statsLevelError};
+                 statsLevelError, threadError, traceError, serveError,
+                 memoryError};
 
 // if line number is 0, skip printing it; if filename or text is NULL skip them too
 // relies on errorcode aligning with an error string in the C file; reports if
@@ -28,4 +30,9 @@ enum ErrorCodes {badblockcount, badcachesize, badblockindex, badCacheID, badAsso
 void error (unsigned errorcode, bool noexit, char* text,
             unsigned linenumber, char* filename);
 
+// for library code that must not exit: while this thread has a trap set, an
+// error that would exit is reported as usual then longjmps to the trap, where
+// setjmp returns errorcode+1; NULL clears the trap
+void errortrap (jmp_buf *trap);
+
 #endif // error_h
\ No newline at end of file
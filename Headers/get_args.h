@@ -2,7 +2,8 @@
  *
  * Check command line and print usage if wrong; if right
  * open config file, read it in and convert to array
- * of strings, one per line.
+ * of strings, one per line. Options come before or after
+ * the config file name, in the usual getopt_long forms.
  *
  * Author:   Philip Machanick
  * Created:  11 April 2012
@@ -16,9 +17,30 @@
 #define get_args_h
 
 #include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
 
-// get the command line and get ready to initialize values needed to get started
-// returns the configuration read in as an array of strings, one per line
-char** get_args (int argc, char *argv[]);
+#include "simulateMultilevelAssoc.h" // RunoptionsT
+#include "readtrace.h"               // TraceformatT
+#include "report.h"                  // ReportformatT
+
+// everything the command line can set: 0 or NULL for what it doesn't
+typedef struct {
+  char *configfile;          // the one argument that is not an option
+  char *socketpath;          // --serve: NULL unless serving
+  char *workloadfile;        // --workload: list of trace files, NULL for stdin
+  ReportformatT format;      // --format
+  RunoptionsT run;           // --flush, --warm, --warmup, --interval, --sample
+  TraceformatT traceformat;  // --trace-format
+  unsigned threads;          // --threads: decoding threads, 0 for one per processor
+  bool seeded;               // --seed: seed replaces the configuration's
+  unsigned long seed;
+  size_t memorylimit;        // --memory-limit: most bytes for the hierarchy, 0 for any
+} OptionsT;
+
+// get the command line into options, printing usage and exiting if it is bad;
+// returns the configuration read in as an array of strings, one per line, or
+// NULL if it can't be read -- or if serving, as the server reads it itself
+char** get_args (int argc, char *argv[], OptionsT *options);
 
 #endif // get_args_h
@@ -0,0 +1,50 @@
+/*
+ * libcachesim.h
+ *
+ * The simulator as a library, for embedding in another program that produces
+ * references itself rather than from trace files: each simulator is a
+ * hierarchy with its own random number generator, and is fed references in
+ * batches. Calls on one simulator are serialized by a lock it holds, so it can
+ * be fed and queried from any number of threads, and separate simulators
+ * share no state so can run in parallel.
+ *
+ * Built as libcachesim.a and libcachesim.so by the Makefile.
+ *
+ */
+
+#ifndef libcachesim_h
+#define libcachesim_h
+
+#include "readtrace.h"       // Trace and reference types
+#include "multilevelAssoc.h" // LevelstatsT
+
+typedef struct Simulator SimulatorT;
+
+// a simulator configured by the text of a configuration file, as for cachesim
+// (lines separated by '\n'), in either format but not a sweep (configfile.h);
+// a bad configuration is reported on stderr as in cachesim, but returns NULL
+// rather than exiting
+SimulatorT *initsimulator (const char *config);
+
+// deallocate memory used -- pass in pointer so we can set it NULL
+void deconstruct_simulator (SimulatorT **simulator);
+
+// simulate a batch of trace records in order, skipping exceptions; an EOFSYMBOL
+// record, one of no known type, or a writeback or victim record when the
+// configuration is not prefiltered ends the batch early; returns the number of
+// records used, or -1 if an error stopped the simulation part way through a
+// record, after which the simulator only returns -1
+int feedsimulator (SimulatorT *simulator, const Trace records[], int Nrecords);
+
+// the stats of one level, numbered as in getlevelstats from 0 for L1 (L1I if
+// split); false if there is no such level
+bool simulatorstats (SimulatorT *simulator, int level, LevelstatsT *stats);
+
+// the stats of up to max levels, all as at the same point between batches;
+// returns the number of levels copied
+int snapshotsimulator (SimulatorT *simulator, LevelstatsT stats[], int max);
+
+// print the stats report cachesim prints after each trace to stdout
+void reportsimulator (SimulatorT *simulator);
+
+#endif // libcachesim_h
@@ -20,6 +20,7 @@ typedef struct Cache CacheT;       // can be multilevel, multiway
 
 #include "readtrace.h"
 #include "generaltypes.h"
+#include "report.h"
 
 //define details of types in C file for abstraction
 
@@ -35,13 +36,33 @@ int countlevels (CacheT *cache[]);
 
 bool is_split (CacheT *cache);
 
+// true if the trace is an L1 miss stream, so writeback and victim records can
+// be handled (see handleVictim)
+bool is_prefiltered (CacheT *cache);
+
 // for multilevel associative cache: true if found in L1
 bool cacheHit (CacheT* thecache[], AddressT where, ReftypeT reftype);
 
 // for multilevel associative cache: report level where found (1 more than max if not)
 int findInCache (CacheT* thecache[], AddressT where, ReftypeT reftype);
 
-void handleReference (CacheT* thecache[], AddressT where, ReftypeT reftype);
+// an access of size bytes from where (0 or 1 for a reference to one block); if
+// it straddles L1 blocks, it is a reference to each
+void handleReference (CacheT* thecache[], AddressT where, ReftypeT reftype,
+                      unsigned size);
+
+// count references of the same type and size starting at where, stride apart:
+// same result as calling handleReference for each
+void handleRun (CacheT* thecache[], AddressT where, ReftypeT reftype,
+                unsigned count, int stride, unsigned size);
+
+// with L1 prefiltered: a block leaving L1 after the last miss, written back to
+// the level below if modified
+void handleVictim (CacheT* thecache[], AddressT where, bool modified);
+
+// handle trace records in order, skipping exceptions; returns the number handled,
+// which is less than Nrecords if one ends the trace
+int handleRecords (CacheT* thecache[], const Trace records[], int Nrecords);
 
 // check for hits, find victim and find an empty slot taking into account
 // associativity in a given level of cache
@@ -51,16 +72,71 @@ CacheAssociativityT assocFindEmpty (CacheT* cache, AddressT address);
 // set up mutliple cache levels; top level can be split
 // and bottom level always finds its referenece 1 level down (RAM)
 // each cache represented in an array with item 0 for L1, LLC last
-// item -- terminated by NULL pointer
-CacheT** initmultilevelcache (CacheSetupT * caches []);
+// item -- terminated by NULL pointer.
+// Nowners, if not 0, attributes blocks to owners, e.g. processes sharing the
+// hierarchy, numbered below Nowners (at most MAXOWNERS, see rawcache.h). A
+// block at a level is owned by whoever's miss put it there (a victim moving
+// down keeps its owner). Each level counts hits and evictions by owner of the
+// reference and owner of the block, misses by owner of the reference, and
+// how many blocks each owner has. These are reported with the other stats and
+// the counts of references reset with them.
+CacheT** initmultilevelcache (CacheSetupT * caches [], unsigned Nowners);
 
 CacheAssociativityT assocCacheHit (CacheT* thecache, AddressT where);
 
 // create a new cache including memory allocation; all blocks initially invalid
 CacheT* initcache (CachesizeT blocks, BlocksizeT blocksize);
 
+// between traces, without building the hierarchy again:
+// flush -- empty every level, victim cache and TLB, and forget the page
+//          table, as for a new process; counts carry on
+// resetmultilevelstats -- counts and times back to 0; what is cached stays
+// reset -- both, and restart replacement choices: the same as a new hierarchy
+void flushmultilevelcache (CacheT *cache[]);
+void resetmultilevelstats (CacheT *cache[]);
+void resetmultilevelcache (CacheT *cache[]);
+
+// switch to another process sharing the hierarchy: the caches keep what they
+// hold, but the TLBs are emptied (the page table stays, shared by all)
+void contextswitch (CacheT *cache[]);
+
+// if attributing to owners, sample how many blocks each has at each level every
+// period references (0, the default, for never); call before simulating. Up to
+// 1024 samples are kept: past that, every other one is dropped and the period
+// doubled. Samples are reset with the stats.
+void sampleowners (CacheT *cache[], unsigned long period);
+
+// the owner of references from here on (0 until set)
+void setowner (CacheT *cache[], unsigned owner);
+
 void deconstruct_multilevelcache (CacheT** caches);
 
 void reportstats (CacheT *cache[]);
 
+// the same for a machine-readable report: for each level (and its victim cache
+// and slices) every count and time by type of reference and in total, with the
+// miss rate; the TLBs; and under unit total, the hierarchy's time, hits and
+// misses and its average memory access time (amat): time per reference to L1.
+// If attributing, each level's values for owner N are under unit level.pN:
+// hitsonM and evictsM for blocks of owner M, hits, misses, blocks (now) and
+// blocks@R sampled after R references
+void reportstatsto (CacheT *cache[], ReportT *report);
+
+// a copy of a level's counts and times, each by type of reference
+enum {LEVELI, LEVELDR, LEVELDW, NLEVELTYPES};
+
+typedef struct {
+    char name [8]; // as in the report: L1 (or L1I and L1D), L2, ...
+    ELAPSED hits [NLEVELTYPES],
+            misses [NLEVELTYPES],
+            replacements [NLEVELTYPES],
+            inclusions [NLEVELTYPES], // victim fills if exclusive
+            hittime [NLEVELTYPES],
+            misstime [NLEVELTYPES],
+            queuetime [NLEVELTYPES];  // waiting for slices
+} LevelstatsT;
+
+// copy the stats of up to max levels, from L1 down; returns the number copied
+int getlevelstats (CacheT *cache[], LevelstatsT stats[], int max);
+
 #endif // multilevelAssoc_h
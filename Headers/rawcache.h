@@ -15,6 +15,8 @@
 
 #include <stdbool.h>
 
+#include "arena.h"
+
 typedef struct RawCache RawCacheT; // single way
 
 typedef unsigned CachesizeT;
@@ -33,6 +35,25 @@ enum tagvalues {
     EXCLUSIVE = 8
 };
 
+// spare tag bits above those hold a block's owner (see initmultilevelcache in
+// multilevelAssoc.h): a byte, so no space beyond the tag word
+#define OWNERSHIFT 8
+#define OWNERMASK  (0xffu << OWNERSHIFT)
+#define MAXOWNERS  256
+#define OWNEROF(tags) (((tags) & OWNERMASK) >> OWNERSHIFT)
+
+
+// how an address picks a block (in a way of an associative cache, picks a set):
+//   maskindex -- block number modulo the number of blocks (a power of 2) by masking
+//   xorindex  -- as maskindex, after XOR-folding all higher bits of the block number
+//                into the index bits; number of blocks must be a power of 2
+//   modindex  -- block number modulo any number of blocks, by multiplying by a
+//                precomputed reciprocal rather than dividing
+//   skewindex -- a different hash for each way (skewed-associative), reduced to
+//                any number of blocks
+// All but maskindex store the whole block number as the address bits so that
+// the block's address can be recovered however it was hashed.
+typedef enum {maskindex, xorindex, modindex, skewindex} IndexfunctionT;
 
 //define details of types in C file for abstraction
 typedef struct Cacheblock CacheblockT;
@@ -40,18 +61,46 @@ typedef struct Cacheblock CacheblockT;
 // true if found in a DM cache
 bool rawCacheHit (RawCacheT* thecache, AddressT where);
 
+// Probe all the ways of a set at once: ways are the DM caches that make up an
+// associative cache (or a slice of one), all the same size and index function.
+// A find kernel returns the way where is in, a findempty kernel the first way
+// with an invalid block in where's set; Nways if none.
+typedef unsigned (*SetprobeT) (RawCacheT *ways[], unsigned Nways, AddressT where);
+
+// the kernels for ways like these: for maskindex and 1, 2, 4, 8 or 16 ways,
+// compiled for that many ways so the loop unrolls, with the index and tag
+// worked out inline once from the level's offset and index bits (which are not
+// compiled in); otherwise general ones
+void setprobesfor (RawCacheT *ways[], unsigned Nways, SetprobeT *find,
+                   SetprobeT *findempty);
+
 CachesizeT getNblocks (RawCacheT* cache);
 
 bool rawcachecheck (RawCacheT *cache);
 
-// create a basic DM cache, ususally embedded in something else
-RawCacheT* initrawcache (CachesizeT blocks, BlocksizeT blocksize);
+// space a cache of the given number of blocks takes in an arena
+size_t rawcachebytes (CachesizeT blocks);
+
+// create a basic DM cache, ususally embedded in something else; allocated from
+// arena, so freed with it
+RawCacheT* initrawcache (CachesizeT blocks, BlocksizeT blocksize, ArenaT *arena);
+
+// as initrawcache with a choice of index function; way selects the hash
+// for skewindex and is ignored otherwise
+RawCacheT* initrawcacheindexed (CachesizeT blocks, BlocksizeT blocksize,
+                                IndexfunctionT indexfunction, unsigned way,
+                                ArenaT *arena);
+
+// invalidate every block at once; owner counts (see setownercounts) are left
+// to the caller, as they may be shared with other caches
+void flushrawcache (RawCacheT *cache);
 
 BlocksizeT getblocksize (RawCacheT *cache);
 
-// deallocate memory used for the cache -- pass in pointer so we can change
-// the value of the actual cache variable
-void deconstruct_cache (RawCacheT** cache);
+// count valid blocks by owner in owned, from here on: each block becoming valid
+// adds 1 to its owner's count, and each one becoming invalid or changing owner
+// takes 1 off; owned may be shared, e.g. by the ways of a level
+void setownercounts (RawCacheT* thecache, unsigned long owned []);
 
 // change state of a block to invalid
 void invalidate (RawCacheT* thecache, CachesizeT whichblock);
@@ -2,7 +2,8 @@
  * readtrace.h
  *
  * Types and operations for reading in a trace file
- * in format [IWRX] hex number where:
+ * in format [IWRX] hex number, optionally followed by ,size in bytes accessed
+ * (decimal), where:
  * I means instruction reference (never modified)
  * W means data write (memory modified at that address)
  * R means data read (that address accessed but unchanged)
@@ -11,6 +12,13 @@
  * terminates either on a line starting with # or on EOF
  * does not check contents
  *
+ * A trace may instead be in the binary delta format of deltatrace.h, which
+ * can have runs of references, or be the output of a tool: Valgrind Lackey
+ * (valgrind --tool=lackey --trace-mem=yes) or DynamoRIO's memtrace samples
+ * (text output), which give each access a size too; their addresses are 64
+ * bits, so those above 4G are folded into 32 bits by hashing the high word
+ * (see foldaddress in readtrace.c)
+ *
  * Author: Philip Machanick
  * Created: 5 January 2012
  * Exceptions added: 8 March 2013
@@ -23,6 +31,7 @@
 #ifndef readtrace_h
 #define readtrace_h
 
+#include <stdio.h> // for type FILE
 #include "generaltypes.h"
 
 typedef char ReftypeT;
@@ -30,6 +39,9 @@ typedef char ReftypeT;
 typedef struct {
   ReftypeT reftype;      // I, W, R, or X: read ends on EOF or #
   unsigned int addr; // not an address for exceptions: wait time in instructions
+  unsigned count;    // references in a run, starting at addr: 1 unless a run
+  int stride;        // difference between addresses in a run
+  unsigned size;     // bytes accessed from each address: 0 if not known
 } Trace;
 
 // stupid C compiler allocates storage more than
@@ -39,11 +51,32 @@ typedef struct {
 #define WRITE 'W'
 #define FETCH 'I'
 #define EXCEPTION 'X'
+// blocks leaving L1, in an L1 miss stream: modified, or not
+#define WRITEBACK 'B'
+#define CLEANVICTIM 'V'
+
+// formats of trace file: autotrace detects each file's from its first bytes
+typedef enum {autotrace, texttrace, deltatrace, lackeytrace, memtracetrace} TraceformatT;
+
+// read every trace in this format instead of detecting it: call before init_tracing
+void settraceformat (TraceformatT format);
 
 // set up internal data structures: must be called first
 void init_tracing (PID maxpid);
-// return the next entry from the trace file (or previous if you backtracked)
+// instead of init_tracing, read just this file as the trace of PID 0, e.g. to
+// convert it (see traceconvert.c); the file is not closed by deconstruct_tracing
+void init_tracingfile (FILE *file);
+// each trace is read in the background from when it is first read; this starts
+// all of them reading now, for traces that run together (e.g. scheduled)
+void start_tracing ();
+// return the next entry from the trace file (or previous if you backtracked);
+// runs are returned a reference at a time
 Trace next_addr (PID proc);
+// return the rest of the chunk of records decoded so far, with the number of
+// them in Nrecords, which are only valid until the next call for this PID; the
+// last record of a trace has type EOFSYMBOL, after which this returns only that;
+// runs are returned as they are, as one record with count > 1
+const Trace *next_chunk (PID proc, int *Nrecords);
 // restore the previously read trace as the next to read
 void backtrack (PID p);
 // dipose internal data structures: call after all traces completed
@@ -0,0 +1,66 @@
+/*
+ * report.h
+ *
+ * Machine-readable results: instead of the usual text tables, the
+ * configuration and each trace's stats as one JSON document or as CSV rows.
+ * Each part of the simulator reports values as
+ *   unit    -- what the value is about: a level (L1, L1I, L2...), its victim
+ *              cache (L2V) or a slice (L3.0), a TLB (DTLB), or a pseudo-unit
+ *              like hierarchy, walks or total
+ *   reftype -- I, DR or DW for a count of one type of reference, or "" for
+ *              one about the unit as a whole (e.g. a total or a parameter)
+ *   name    -- e.g. hits, misses, missrate, associativity
+ * which become
+ *   csv:  a header then a row "workload,unit,reftype,name,value" per value,
+ *         workload being "config" for the configuration, otherwise the number
+ *         of the trace file (from 0)
+ *   json: {"configuration": {unit: {name: value, ...}, ...},
+ *          "workloads": [{"workload": N, unit: {reftype: {name: value, ...},
+ *                         ..., name: value, ...}, ...}, ...]}
+ * A sweep of configurations (see configfile.h) reports each point in turn,
+ * starting with reportsweep: csv then has a first column point, the point's
+ * number from 0, and json is {"sweep": [{"point": N, "configuration": ...,
+ * "workloads": ...}, ...]}.
+ * Stats part way through a trace (reportinterval) are reported as another
+ * workload, after the number of references simulated so far: csv gives the
+ * workload as N@references, json adds "references": references to its object.
+ * A unit's values, and within a unit those of each reftype, must be reported
+ * together.
+ *
+ */
+
+#ifndef report_h
+#define report_h
+
+#include <stdio.h>
+
+#include "generaltypes.h"
+
+// textformat is the usual tables, printed directly rather than through here
+typedef enum {textformat, jsonformat, csvformat} ReportformatT;
+
+typedef struct Report ReportT;
+
+// NULL for textformat
+ReportT *initreport (ReportformatT format, FILE *output);
+
+// what is reported next is a point of a sweep: its configuration then its
+// workloads; must come before anything else if there is a sweep at all
+void reportsweep (ReportT *report, int point);
+
+// what is reported next is the configuration, or the stats of a trace file
+void reportconfiguration (ReportT *report);
+void reportworkload (ReportT *report, PID workload);
+void reportinterval (ReportT *report, PID workload, unsigned long references);
+
+void reportcount (ReportT *report, const char *unit, const char *reftype,
+                  const char *name, ELAPSED value);
+void reportratio (ReportT *report, const char *unit, const char *reftype,
+                  const char *name, double value);
+void reportstring (ReportT *report, const char *unit, const char *reftype,
+                   const char *name, const char *value);
+
+// end the output (for json, close the document) and deallocate
+void finishreport (ReportT **report);
+
+#endif // report_h
@@ -0,0 +1,37 @@
+/*
+ * rng.h
+ *
+ * Random number generators for replacement: each cache level (and the TLBs)
+ * has its own, allocated with its hierarchy, so nothing is shared between
+ * levels or between hierarchies simulated at the same time, e.g. from
+ * different threads, and no lock is taken. A seed and a stream number fix the
+ * sequence: each level draws from its own stream, so its choices don't depend
+ * on how many numbers other levels have used.
+ *
+ */
+
+#ifndef rng_h
+#define rng_h
+
+#include <stdint.h>
+
+#include "arena.h"
+
+typedef struct Random RandomT;
+
+// space one takes in an arena
+size_t randombytes ();
+
+// allocated from arena, so freed with it
+RandomT *initrandom (uint64_t seed, unsigned stream, ArenaT *arena);
+
+// start the sequence again, as if new from initrandom
+void reseedrandom (RandomT *rng, uint64_t seed, unsigned stream);
+
+// the next number, from 0 to 2^32-1
+uint32_t nextrandom (RandomT *rng);
+
+// the next number from 0 to below-1, without a divide
+unsigned randombelow (RandomT *rng, unsigned below);
+
+#endif // rng_h
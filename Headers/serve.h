@@ -0,0 +1,69 @@
+/*
+ * serve.h
+ *
+ * Server mode, started as
+ *   cachesim --serve <socket path> <configuration file>
+ * keeps one simulated hierarchy warm for as long as it runs: local clients
+ * send it references and ask for stats whenever they like, so a profiler
+ * taking samples continuously needn't restart and rewarm the caches for each
+ * collection window.
+ *
+ * Clients connect to a UNIX domain stream socket. Every message, either way,
+ * is a ServeHeaderT followed by length bytes of payload:
+ *   SERVEFEED  -- references to simulate, length/sizeof (ServeRecordT) of
+ *                 them; no reply, unless one is not I, R, W or X: those
+ *                 before it are simulated, it and the rest are not, and the
+ *                 reply is SERVEERROR with no payload
+ *   SERVESTATS -- no payload; the reply is a SERVESTATS message holding a
+ *                 LevelstatsT (see multilevelAssoc.h) for each level, after
+ *                 everything sent before, including in rings, is simulated
+ *   SERVERING  -- the payload is the name of a POSIX shared memory object
+ *                 (shm_open) holding a ServeRingT, which the server then
+ *                 drains as well as the socket until the client disconnects;
+ *                 the reply is SERVERING with no payload, or SERVEERROR
+ *   SERVEQUIT  -- no payload; the server reports its stats and stops
+ * A ring needs no system call per batch: the client adds records at head and
+ * the server removes them at tail, each only advancing its own counter. A
+ * ring holding a record that can't be fed, or more than its capacity as
+ * attached, is detached.
+ *
+ */
+
+#ifndef serve_h
+#define serve_h
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "multilevelAssoc.h" // LevelstatsT
+
+enum {SERVEFEED = 'F', SERVESTATS = 'S', SERVERING = 'M', SERVEQUIT = 'Q',
+      SERVEERROR = 'E'};
+
+typedef struct {
+    uint32_t type,   // one of the above
+             length; // payload bytes that follow
+} ServeHeaderT;
+
+// most payload a message can have
+#define MAXSERVEPAYLOAD (1u << 20)
+
+typedef struct {
+    uint32_t addr;
+    char reftype;    // I, R, W or X, as in a trace
+} ServeRecordT;
+
+// a single-producer single-consumer ring in shared memory: record i is in
+// records[i % capacity]; the client fills records then advances head, the
+// server empties them then advances tail, so head - tail records are waiting
+typedef struct {
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t tail;
+    uint32_t capacity;  // a power of 2
+    ServeRecordT records [];
+} ServeRingT;
+
+// serve until told to quit or interrupted; returns the exit status
+int serve (char *socketpath, char *configfile);
+
+#endif // serve_h
@@ -3,8 +3,10 @@
  * 
  * Trace-driven N-way multilevel associative cache simulation, with stats.
  * Configuration is passed in and used to set up the simulated cache.
- * Resets stats after each trace file; would need a scheduler and other OS machinery
- * to simulate a real multitasking workload
+ * The hierarchy is built once: between trace files it is reset to as new, or only
+ * flushed, or only has its stats reset (see BetweentracesT). Or a simple scheduler
+ * (see SchedulingT) interleaves the traces as processes sharing the hierarchy, to
+ * see how they interfere
  *
  * Philip Machanick
  * June 2018
@@ -16,7 +18,56 @@
 
 #include "multilevelAssoc.h"
 
-// report timing stats after simulating workload to completion
-void simulateMultilevelAssoc (CacheSetupT* paremeters[]);
+// what happens to the hierarchy between trace files:
+//   resetbetween -- as new: empty with counts at 0, so each trace is simulated alone
+//   flushbetween -- emptied but counts carry on, totalling the whole workload
+//   warmbetween  -- counts back to 0 but contents kept, so each trace starts
+//                   with the caches as the last left them
+typedef enum {resetbetween, flushbetween, warmbetween} BetweentracesT;
+
+// references sampled at a time (see RunoptionsT)
+#define SAMPLEWINDOW 10000
+
+// how traces share the hierarchy:
+//   noschedule        -- one after another, as BetweentracesT says
+//   roundrobin        -- interleaved, each running for a quantum of references
+//                        in turn; exceptions are ignored
+//   switchonexception -- interleaved, each running until an exception, which
+//                        makes it wait for as many references as the exception's
+//                        wait time, or until it has run for a quantum if one is set
+// Time is counted in references simulated, all processes' together; addresses
+// are as given, so traces share whatever addresses they have in common. On each
+// switch the TLBs are emptied, as without address space IDs; caches keep their
+// contents.
+typedef enum {noschedule, roundrobin, switchonexception} SchedulingT;
+
+// references a round-robin quantum has unless set
+#define DEFAULTQUANTUM 10000
+
+// how each trace is run, counting references (not exceptions) from its start;
+// all 0 to simulate and count everything
+typedef struct {
+    BetweentracesT between;
+    unsigned long warmup,   // references that only warm the caches: counts are
+                            // reset after them
+                  interval, // after warm-up, also report the stats so far every
+                            // this many references
+                  sample;   // after warm-up, only simulate the first of every
+                            // sample windows of SAMPLEWINDOW references: the
+                            // rest are skipped, so results are an estimate
+    SchedulingT schedule;   // if not noschedule, the options above are unused
+    unsigned long quantum;  // references a process may run before a switch; 0
+                            // for no limit
+    bool attribute;         // attribute blocks to the traces whose references
+                            // brought them in (see initmultilevelcache)
+    unsigned long occupancy;// if attributing, sample each trace's blocks every
+                            // this many references: 0 for never
+} RunoptionsT;
+
+// report timing stats after simulating each trace of the workload to completion,
+// or all of them interleaved if scheduled: as text unless there is a
+// machine-readable report
+void simulateMultilevelAssoc (CacheSetupT* paremeters[], RunoptionsT *options,
+                              ReportT *report);
 
 #endif // simulateMultilevelAssoc_h
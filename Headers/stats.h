@@ -20,14 +20,21 @@
 #include <stdbool.h>
 
 #include "generaltypes.h" // for type ELAPSED
+#include "arena.h"
 
 // make 1 of these for each kind of stats you want including clock
 // ticks for each tye pof reference; use a separate one for hits
 // and misses, for example
 typedef struct Stats StatsT;
 
-// call at start
-StatsT* init_stats ();
+// space one takes in an arena
+size_t statsbytes ();
+
+// call at start: allocated from arena, so freed with it
+StatsT* init_stats (ArenaT *arena);
+
+// set all counts back to 0
+void reset_stats (StatsT * stats);
 
 // increase instruction count
 void incrIcount (StatsT * stats);
@@ -48,6 +55,13 @@ void incrDRcost (StatsT * stats, ELAPSED cost);
 // increase data write cost
 void incrDWcost (StatsT * stats, ELAPSED cost);
 
+// increase counts by more than 1 at a time
+void addIcount (StatsT * stats, ELAPSED count);
+
+void addDRcount (StatsT * stats, ELAPSED count);
+
+void addDWcount (StatsT * stats, ELAPSED count);
+
 
 // get values of counters
 ELAPSED getIcount (StatsT * stats);
@@ -56,8 +70,4 @@ ELAPSED getDRcount (StatsT * stats);
 
 ELAPSED getDWcount (StatsT * stats);
 
-// call at the end to dispose data structure (for each one used)
-// need extra pointer layer to dispose and reset pointer to NULL
-void deconstruct_stats (StatsT ** stats);
-
 #endif // stats_h
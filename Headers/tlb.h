@@ -0,0 +1,73 @@
+/*
+ * tlb.h
+ *
+ * Address translation in front of a cache hierarchy: first-level instruction
+ * and data TLBs, a shared second-level TLB and the page table behind them.
+ * Virtual pages are given physical frames in the order they are first touched,
+ * so the mapping is the same every run. The page table is a 4-level radix tree
+ * (as x86-64) of 8-byte entries in 4KiB tables, itself given physical frames;
+ * 2MiB and 1GiB pages end the walk 1 or 2 levels early. Reading the page table
+ * entries is up to the caller, so they can be looked up in the data caches.
+ *
+ */
+
+#ifndef tlb_h
+#define tlb_h
+
+#include <stdbool.h>
+
+#include "rawcache.h"
+#include "cachesetup.h"
+#include "readtrace.h"
+#include "stats.h"
+#include "rng.h"
+#include "report.h"
+
+typedef struct TLBs TLBsT;
+
+// most page table entries read in one walk
+#define MAXWALK 4
+
+// set up the TLBs described in the first level's parameters, replacing entries
+// with random choices from random; NULL if there are none, in which case there
+// is no translation
+TLBsT* inittlbs (CacheSetupT *firstlevel, RandomT *random, ArenaT *arena);
+
+// space the TLBs and page table take in an arena, from which inittlbs allocates
+// them so they are freed with it
+size_t tlbsbytes (CacheSetupT *firstlevel);
+
+// empty the TLBs and forget the page table, as for a new process: pages get
+// frames afresh; counts are kept
+void flushtlbs (TLBsT* tlbs);
+
+// only empty the TLBs, as on a context switch without address space IDs
+void flushtlbentries (TLBsT* tlbs);
+
+// set the counts of lookups and walks back to 0
+void resettlbstats (TLBsT* tlbs);
+
+// look a virtual address up in the TLBs: the first-level TLB for the kind of
+// reference, then the second-level TLB, filling the first-level TLB on a hit
+// there; true with the physical address in physical if found
+bool tlbLookup (TLBsT* tlbs, AddressT virtual, ReftypeT reftype, AddressT *physical);
+
+// after a miss in all the TLBs: give the page a frame if it has none yet and
+// return the number of page table entries a walk reads, top level first, with
+// their physical addresses in ptes
+int tlbWalk (TLBsT* tlbs, AddressT virtual, AddressT ptes[MAXWALK]);
+
+// after a walk costing walkcost, put the translation in the TLBs and return
+// the physical address
+AddressT tlbFill (TLBsT* tlbs, AddressT virtual, ReftypeT reftype, ELAPSED walkcost);
+
+// print hits, misses, lookup time and walk time of each TLB and return the total
+// lookup time (walk time is already in the data caches' times)
+ELAPSED reporttlbs (TLBsT* tlbs);
+
+// the same for a machine-readable report, by type of reference: each TLB's
+// hits, misses and lookup time, and the page walks (unit walks); adds each
+// type's lookup time to lookuptime, indexed I, DR, DW
+void reporttlbsto (TLBsT* tlbs, ReportT *report, ELAPSED lookuptime [3]);
+
+#endif // tlb_h
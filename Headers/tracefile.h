@@ -0,0 +1,26 @@
+/*
+ * tracefile.h
+ *
+ * Open a trace file, decompressing it on the fly if compressed, so that
+ * compressed traces can be read directly rather than decompressed to disk or
+ * a pipe first. Detected from magic bytes at the start of the file:
+ *   gzip      -- through zlib
+ *   LZ4 frame -- decoded here; independent blocks are decoded in parallel
+ * Anything else is read as is.
+ *
+ */
+
+#ifndef tracefile_h
+#define tracefile_h
+
+#include <stdio.h> // for type FILE
+
+// open a trace file for reading; returns a stream of the decompressed text, or
+// NULL with errno set if the file can't be opened or its compression isn't supported
+FILE *opentracefile (const char *filename);
+
+// most threads to decode LZ4 blocks with, for files opened after; 0 (the
+// default) for one per processor
+void settracethreads (unsigned threads);
+
+#endif // tracefile_h
@@ -0,0 +1,48 @@
+/*
+ * victimcache.h
+ *
+ * A small fully-associative buffer of blocks evicted from a cache level.
+ * Lookups go through a hash index on the block address rather than a scan of
+ * every entry, so they cost the same however many entries there are. When
+ * full, the least recently added block is pushed out; since a hit takes the
+ * block out again (it is swapped back into the cache level it came from), that
+ * is also the least recently used one. No timing: that is up to the level
+ * the victim cache is attached to.
+ *
+ */
+
+#ifndef victimcache_h
+#define victimcache_h
+
+#include <stdbool.h>
+
+#include "rawcache.h"
+
+typedef struct VictimCache VictimCacheT;
+
+// space a victim cache of the given number of blocks takes in an arena
+size_t victimcachebytes (CachesizeT blocks);
+
+// create an empty victim cache of the given number of blocks, allocated from
+// arena, so freed with it
+VictimCacheT* initvictimcache (CachesizeT blocks, BlocksizeT blocksize, ArenaT *arena);
+
+// empty it, as when new
+void flushvictimcache (VictimCacheT* cache);
+
+CachesizeT getVictimNblocks (VictimCacheT* cache);
+
+// true if the block containing the address is held
+bool victimHit (VictimCacheT* cache, AddressT where);
+
+// if the block containing the address is held, remove it, returning its tag
+// bits through tags, and return true; otherwise return false
+bool victimTake (VictimCacheT* cache, AddressT where, TagT *tags);
+
+// add the block containing the address with the given tag bits; if that pushes
+// out the oldest block, return true with the pushed out block's address and
+// tag bits in pushedout and pushedtags
+bool victimPut (VictimCacheT* cache, AddressT where, TagT tags,
+                AddressT *pushedout, TagT *pushedtags);
+
+#endif // victimcache_h
@@ -23,8 +23,8 @@
 #include "readtrace.h"
 #include <stdio.h> // for type FILE
 
-// call at start
-bool init_workloads ();
+// call at start: read the list of trace files, one per line, from list (e.g. stdin)
+bool init_workloads (FILE *list);
 
 // get highest PID (add 1 for number of processes)
 PID getmaxPID ();
@@ -38,6 +38,10 @@ FILE *getfile (PID proc);
 // indicate that the given file has hit EOF
 void filedone (PID proc);
 
+// open every file again from the start, to run the workload again (e.g. on
+// the next configuration of a sweep); false if any can't be
+bool rewind_workloads ();
+
 // call at the end to dispose data structures
 void deconstruct_workload ();
 
@@ -0,0 +1,106 @@
+/*
+ * arena.c
+ *
+ * One allocation for a group of structures that are freed together; see
+ * arena.h. The arena's own bookkeeping is at the start of its memory, so it
+ * takes no separate allocation either.
+ *
+ * The memory is an anonymous mapping, which the OS zeroes a page at a time as
+ * it is first touched, so untouched parts (like the sets of a big cache level
+ * no reference has reached) take no memory or time to set up. A big arena is
+ * aligned to huge pages and asks for them, for fewer TLB misses when it is
+ * used all over, as big tag arrays are.
+ *
+ */
+
+#include "arena.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+// arenas at least this big are aligned to it and ask for huge pages
+#define HUGEPAGE ((size_t) 2 << 20)
+
+// ranges at least this big are zeroed by dropping their pages rather than memset
+#define ZEROBYDROPPING ((size_t) 1 << 20)
+
+struct Arena {
+    void *memory;     // as mapped, to unmap
+    size_t mapped;
+    char *next,       // the next allocation starts here
+         *end;
+}; // typedef ArenaT
+
+static size_t limit = 0; // most bytes an arena may have: 0 for no limit
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+size_t arenabytes (size_t bytes) {
+    return (bytes + ARENAALIGN - 1) & ~(size_t) (ARENAALIGN - 1);
+}
+
+ArenaT *initarena (size_t bytes) {
+    if (limit && bytes > limit)
+        error (memoryError, false, "arena: more than the memory limit", __LINE__, __FILE__);
+    size_t total = arenabytes (sizeof (ArenaT)) + bytes,
+           alignment = total >= HUGEPAGE ? HUGEPAGE : ARENAALIGN,
+           mapped = total + alignment - ARENAALIGN; // mappings are page aligned
+    // NORESERVE: only pages touched count against the system's memory
+    void *memory = mmap (NULL, mapped, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED)
+        error (memoryError, false, "arena", __LINE__, __FILE__);
+    uintptr_t start = ((uintptr_t) memory + alignment - 1) & ~(uintptr_t) (alignment - 1);
+#ifdef MADV_HUGEPAGE
+    if (alignment == HUGEPAGE)
+        madvise ((void *) start, total & ~(HUGEPAGE - 1), MADV_HUGEPAGE); // a hint only
+#endif
+    ArenaT *arena = (ArenaT *) start;
+    arena->memory = memory;
+    arena->mapped = mapped;
+    arena->next = (char *) arena + arenabytes (sizeof (ArenaT));
+    arena->end = (char *) arena + total;
+    return arena;
+}
+
+void setarenalimit (size_t bytes) {
+    limit = bytes;
+}
+
+void *arenaalloc (ArenaT *arena, size_t bytes) {
+    bytes = arenabytes (bytes);
+    if (bytes > arena->end - arena->next)
+        error (memoryError, false, "arena too small", __LINE__, __FILE__);
+    void *allocated = arena->next;
+    arena->next += bytes;
+    return allocated;
+}
+
+void arenazero (void *memory, size_t bytes) {
+    uintptr_t pagesize = sysconf (_SC_PAGESIZE),
+              start = (uintptr_t) memory, end = start + bytes,
+              first = (start + pagesize - 1) & ~(pagesize - 1), // whole pages only
+              last = end & ~(pagesize - 1);
+    // a private anonymous page dropped reads as zero next time, costing nothing
+    // if it isn't touched again
+    if (bytes < ZEROBYDROPPING || madvise ((void *) first, last - first, MADV_DONTNEED)) {
+        memset (memory, 0, bytes);
+        return;
+    }
+    memset (memory, 0, first - start);
+    memset ((void *) last, 0, end - last);
+}
+
+void deconstruct_arena (ArenaT **arena) {
+    munmap ((*arena)->memory, (*arena)->mapped);
+    *arena = NULL;
+}
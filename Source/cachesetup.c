@@ -16,6 +16,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 struct CacheSetup {
     CachesizeT totalblocks;
@@ -24,32 +25,68 @@ struct CacheSetup {
              lookupoverhead;
     CacheAssociativityT associativity;
     bool split;
+    InclusionT inclusion;
+    CachesizeT victimblocks; // 0 if no victim cache attached
+    LatencyT victimhittime;
+    IndexfunctionT indexfunction;
+    unsigned slices,      // 1 if not sliced
+             slicewindow; // requests over which slices contend
+    // TLBs for the whole hierarchy, only used in the first level's parameters
+    CachesizeT tlbentries [NTLBKINDS]; // 0 if that TLB is absent
+    CacheAssociativityT tlbassociativity [NTLBKINDS];
+    LatencyT tlbhittime [NTLBKINDS];
+    PagesizeT pagesize;
+    // L1 filtering, only used in the first level's parameters
+    char *filterout;  // file for the L1 miss stream; NULL if not filtering
+    bool prefiltered; // the trace is such a stream: L1 is not simulated
+    unsigned long seed; // replacement choices, only used in the first level's parameters
+    ArenaT *arena;    // holds all the parameters of a configuration and their strings
 }; // typedef CacheSetupT
 
-// add a new set of cache parameters to the list: because of realloc, should
-// assign the result back to the original data structure; inserts the given
-// pointer and does not copy so it should not be freed outside of managing this
-// data structure
-CacheSetupT **addCacheParameters (CacheSetupT* allparemeters[], CacheSetupT *newone) {
-    int Nparameters = parameterlen (allparemeters);
-    allparemeters = realloc (allparemeters, sizeof(CacheSetupT*)*(Nparameters+2));
-    allparemeters[Nparameters] = newone;
-    allparemeters[Nparameters+1] = NULL;
-    return allparemeters;
-}
+static const char *inclusionnames [] = {"inclusive", "noninclusive", "exclusive"};
+
+#define Ninclusionnames (sizeof (inclusionnames) / sizeof (const char *))
+
+// in the same order as IndexfunctionT
+static const char *indexnames [] = {"mask", "xor", "mod", "skew"};
+
+#define Nindexnames (sizeof (indexnames) / sizeof (const char *))
+
+// in the same order as TLBkindT
+static const char *tlbnames [] = {"I", "D", "S"};
+
+static const char *pagesizenames [] = {"4K", "2M", "1G"};
+static const PagesizeT pagesizes [] = {1u<<12, 1u<<21, 1u<<30};
+
+#define Npagesizes (sizeof (pagesizes) / sizeof (PagesizeT))
+
+static bool setoption (CacheSetupT *setup, char *option);
 
 CacheSetupT *makeCacheParameters (CachesizeT totalblocks,
     BlocksizeT blocksize,
     LatencyT hittime, LatencyT lookupoverhead,
-    CacheAssociativityT associativity, bool split) {
+    CacheAssociativityT associativity, bool split, ArenaT *arena) {
     
-    CacheSetupT *newparameters = malloc (sizeof(CacheSetupT));
+    CacheSetupT *newparameters = arenaalloc (arena, sizeof(CacheSetupT));
     newparameters->totalblocks = totalblocks;
     newparameters->blocksize = blocksize;
     newparameters->hittime = hittime;
     newparameters->lookupoverhead = lookupoverhead;
     newparameters->associativity = associativity;
     newparameters->split = split;
+    newparameters->inclusion = inclusive;
+    newparameters->victimblocks = 0;
+    newparameters->victimhittime = 0;
+    newparameters->indexfunction = maskindex;
+    newparameters->slices = 1;
+    newparameters->slicewindow = DEFAULTSLICEWINDOW;
+    for (int i = 0; i < NTLBKINDS; i++)
+        newparameters->tlbentries[i] = 0;
+    newparameters->pagesize = pagesizes[0];
+    newparameters->filterout = NULL;
+    newparameters->prefiltered = false;
+    newparameters->seed = DEFAULTSEED;
+    newparameters->arena = arena;
     return newparameters;
 
 }
@@ -63,9 +100,10 @@ void reportParameters (CacheSetupT* allparemeters[]) {
         return;
     }
     printf ("\tblks\tblksize\thitT\tlookupT\tassoc\tsplit?\tTotal Bytes\n");
+    // index function and slices only shown if not the default
     bool splitL1 = allparemeters[0]->split;
     for (int i = 0; i < Nparameters-1; i++) {
-        printf ("L%d%s:\t%u\t%u\t%lu\t%lu\t%u\t%d\t%u\n", level,
+        printf ("L%d%s:\t%u\t%u\t%lu\t%lu\t%u\t%d\t%u%s%s", level,
                 splitL1?(i==0?"I":(i==1?"D":"")):"",
                 allparemeters[i]->totalblocks,
                 allparemeters[i]->blocksize,
@@ -74,44 +112,199 @@ void reportParameters (CacheSetupT* allparemeters[]) {
                 allparemeters[i]->associativity,
                 (allparemeters[i]->split?1:0),
                 allparemeters[i]->totalblocks*
-                allparemeters[i]->blocksize
+                allparemeters[i]->blocksize,
+                allparemeters[i]->indexfunction != maskindex?"\tindex=":"",
+                allparemeters[i]->indexfunction != maskindex?
+                    indexnames[allparemeters[i]->indexfunction]:""
                );
+        if (allparemeters[i]->slices > 1)
+            printf ("\tslices=%u/%u", allparemeters[i]->slices,
+                    allparemeters[i]->slicewindow);
+        printf ("\n");
+        if (allparemeters[i]->victimblocks)
+            printf ("L%d%sV:\t%u\t%u\t%lu\t%lu\t%u\t%d\t%u\n", level,
+                    splitL1?(i==0?"I":(i==1?"D":"")):"",
+                    allparemeters[i]->victimblocks,
+                    allparemeters[i]->blocksize,
+                    allparemeters[i]->victimhittime,
+                    0ul,
+                    allparemeters[i]->victimblocks, // fully associative
+                    0,
+                    allparemeters[i]->victimblocks*
+                    allparemeters[i]->blocksize
+                   );
         if (i > 0)
             level++;
         else if (!splitL1)
             level++;
     }
     printf ("DRAM:\t\t\t%lu\n", allparemeters[Nparameters-1]->hittime);
+    // TLBs: blocks are entries, block size the page size
+    for (int i = 0; i < NTLBKINDS; i++)
+        if (allparemeters[0]->tlbentries[i])
+            printf ("%sTLB:\t%u\t%u\t%lu\t%lu\t%u\t%d\t%lu\n", tlbnames[i],
+                    allparemeters[0]->tlbentries[i],
+                    allparemeters[0]->pagesize,
+                    allparemeters[0]->tlbhittime[i],
+                    0ul,
+                    allparemeters[0]->tlbassociativity[i],
+                    0,
+                    (unsigned long) allparemeters[0]->tlbentries[i]*
+                    allparemeters[0]->pagesize
+                   );
+    if (allparemeters[0]->inclusion != inclusive)
+        printf ("Inclusion:\t%s\n", inclusionnames[allparemeters[0]->inclusion]);
+    if (allparemeters[0]->filterout)
+        printf ("Filter:\t\tL1 only, misses to %s\n", allparemeters[0]->filterout);
+    if (allparemeters[0]->prefiltered)
+        printf ("Prefiltered:\tL1\n");
+    if (allparemeters[0]->seed != DEFAULTSEED)
+        printf ("Seed:\t\t%lu\n", allparemeters[0]->seed);
+}
+
+void reportParametersTo (CacheSetupT* allparemeters[], ReportT *report) {
+    int Nparameters = parameterlen (allparemeters);
+    bool splitL1 = Nparameters && allparemeters[0]->split;
+    char unit [16];
+    reportconfiguration (report);
+    for (int i = 0, level = 1; i < Nparameters-1; i++) {
+        CacheSetupT *setup = allparemeters[i];
+        snprintf (unit, sizeof (unit), "L%d%s", level,
+                  splitL1?(i==0?"I":(i==1?"D":"")):"");
+        reportcount (report, unit, "", "blocks", setup->totalblocks);
+        reportcount (report, unit, "", "blocksize", setup->blocksize);
+        reportcount (report, unit, "", "bytes",
+                     (ELAPSED) setup->totalblocks*setup->blocksize);
+        reportcount (report, unit, "", "hittime", setup->hittime);
+        reportcount (report, unit, "", "lookuptime", setup->lookupoverhead);
+        reportcount (report, unit, "", "associativity", setup->associativity);
+        reportstring (report, unit, "", "index", indexnames[setup->indexfunction]);
+        reportcount (report, unit, "", "slices", setup->slices);
+        reportcount (report, unit, "", "slicewindow", setup->slicewindow);
+        reportcount (report, unit, "", "victimblocks", setup->victimblocks);
+        reportcount (report, unit, "", "victimhittime", setup->victimhittime);
+        if (i > 0 || !splitL1)
+            level++;
+    }
+    if (Nparameters)
+        reportcount (report, "DRAM", "", "hittime",
+                     allparemeters[Nparameters-1]->hittime);
+    for (int i = 0; Nparameters && i < NTLBKINDS; i++)
+        if (allparemeters[0]->tlbentries[i]) {
+            snprintf (unit, sizeof (unit), "%sTLB", tlbnames[i]);
+            reportcount (report, unit, "", "entries", allparemeters[0]->tlbentries[i]);
+            reportcount (report, unit, "", "associativity",
+                         allparemeters[0]->tlbassociativity[i]);
+            reportcount (report, unit, "", "hittime", allparemeters[0]->tlbhittime[i]);
+        }
+    if (!Nparameters)
+        return;
+    reportstring (report, "hierarchy", "", "inclusion",
+                  inclusionnames[allparemeters[0]->inclusion]);
+    reportcount (report, "hierarchy", "", "split", splitL1);
+    reportcount (report, "hierarchy", "", "pagesize", allparemeters[0]->pagesize);
+    reportcount (report, "hierarchy", "", "seed", allparemeters[0]->seed);
+    reportstring (report, "hierarchy", "", "filterout",
+                  allparemeters[0]->filterout ? allparemeters[0]->filterout : "");
+    reportcount (report, "hierarchy", "", "prefiltered", allparemeters[0]->prefiltered);
 }
 
 // a line in the form of a null-terminated string containing:
 // cache size in bytes, block size in bytes, hit time, miss overhead, associativity
-// and whether spit I+D (1 split, 0 not: should only be the case in L1)
-CacheSetupT *makeCacheParametersStr (char *line) {
-    if (isnumbers (line)) {
-        CachesizeT totalsize;
-        BlocksizeT blocksize;
-        LatencyT hittime,
-        lookupoverhead;
-        CacheAssociativityT associativity;
-        int splitasint;
-        bool split;
-        if (sscanf(line, "%u %u %lu %lu %u %d", &totalsize, &blocksize, &hittime,
-            &lookupoverhead, &associativity, &splitasint) == 6) {
+// and whether spit I+D (1 split, 0 not: should only be the case in L1), optionally
+// followed by name=value options
+CacheSetupT *makeCacheParametersStr (char *line, ArenaT *arena) {
+    CachesizeT totalsize;
+    BlocksizeT blocksize;
+    LatencyT hittime,
+    lookupoverhead;
+    CacheAssociativityT associativity;
+    int splitasint;
+    int numberslength = 0; // where the options start, if any
+    if (sscanf(line, "%u %u %lu %lu %u %d%n", &totalsize, &blocksize, &hittime,
+        &lookupoverhead, &associativity, &splitasint, &numberslength) == 6) {
+        // only the six numbers are checked as numbers: temporarily end the line there
+        char afternumbers = line[numberslength];
+        line[numberslength] = '\0';
+        bool numbersOK = isnumbers (line);
+        line[numberslength] = afternumbers;
+        if (numbersOK) {
             CachesizeT nBlocks = blocksize?totalsize/blocksize:totalsize;
             if (blocksize && totalsize % blocksize)
                error (configError, false, "Total size not a multiple of block size",
                       __LINE__, __FILE__);
-            return makeCacheParameters (nBlocks, blocksize, hittime,
-                                        lookupoverhead, associativity, splitasint!=0);
+            CacheSetupT *newparameters = makeCacheParameters (nBlocks, blocksize, hittime,
+                                        lookupoverhead, associativity, splitasint!=0,
+                                        arena);
+            for (char *option = strtok (&line[numberslength], " \t\r");
+                 option; option = strtok (NULL, " \t\r"))
+                if (!setoption (newparameters, option))
+                    error (configError, false, option, __LINE__, __FILE__);
+            return newparameters;
         }
-       
     }
     // only get here if an error in parameters
     error (configError, false, line, __LINE__, __FILE__);
     return NULL; // keep compilers that check for return value happy, error exits
 }
 
+// a line in the form "victim <blocks> <hit time>" attaches a fully-associative
+// victim cache of that many blocks to the level given by previous line
+static bool isvictimline (char *line) {
+    return !strncmp (line, "victim", strlen ("victim"));
+}
+
+static void addVictimCache (CacheSetupT *level, char *line) {
+    CachesizeT victimblocks;
+    LatencyT victimhittime;
+    char *numbers = &line[strlen ("victim")];
+    if (!level || !isnumbers (numbers) ||
+        sscanf (numbers, "%u %lu", &victimblocks, &victimhittime) != 2 || !victimblocks)
+        error (configError, false, line, __LINE__, __FILE__);
+    level->victimblocks = victimblocks;
+    level->victimhittime = victimhittime;
+}
+
+// a line in the form "tlb I|D|S <entries> <associativity> <hit time>", optionally
+// followed by page=4K|2M|1G, adds a TLB to the hierarchy; TLBs are kept with the
+// first level's parameters, like split
+static bool istlbline (char *line) {
+    return !strncmp (line, "tlb", strlen ("tlb"));
+}
+
+static void addTLB (CacheSetupT *firstlevel, char *line) {
+    char kind;
+    CachesizeT entries;
+    CacheAssociativityT associativity;
+    LatencyT hittime;
+    int numberslength = 0;
+    if (!firstlevel ||
+        sscanf (line, "tlb %c %u %u %lu%n", &kind, &entries, &associativity, &hittime,
+                &numberslength) != 4 || !entries || !associativity ||
+        entries % associativity)
+        error (configError, false, line, __LINE__, __FILE__);
+    int which;
+    for (which = 0; which < NTLBKINDS; which++)
+        if (kind == tlbnames[which][0])
+            break;
+    if (which == NTLBKINDS)
+        error (configError, false, line, __LINE__, __FILE__);
+    firstlevel->tlbentries[which] = entries;
+    firstlevel->tlbassociativity[which] = associativity;
+    firstlevel->tlbhittime[which] = hittime;
+    for (char *option = strtok (&line[numberslength], " \t\r");
+         option; option = strtok (NULL, " \t\r")) {
+        int i;
+        for (i = 0; i < Npagesizes; i++)
+            if (!strncmp (option, "page=", strlen ("page=")) &&
+                !strcmp (&option[strlen ("page=")], pagesizenames[i]))
+                break;
+        if (i == Npagesizes)
+            error (configError, false, option, __LINE__, __FILE__);
+        firstlevel->pagesize = pagesizes[i];
+    }
+}
+
 // Maintaining inclusion gets complicated if block sizes vary
 // if higher-evel bigger, OK; if higher level smaller, every eviction
 // from a lower level with bigger blocks must evict any at higher level
@@ -126,25 +319,63 @@ void checkparameters (CacheSetupT * caches []) {
                  error (configError, false,
                         "Only DRAM layer may have zeros in block attributes",
                         __LINE__, __FILE__);
+              if (thiscache->victimblocks)
+                 error (configError, false, "DRAM layer can't have a victim cache",
+                        __LINE__, __FILE__);
+              if (thiscache->slices > 1)
+                 error (configError, false, "DRAM layer can't be sliced",
+                        __LINE__, __FILE__);
         }
 #ifdef DEBUG
         fprintf (stderr, "Checking %d vs. %d: %u == %u\n", i, i-1,
                  thiscache->blocksize, lastcache->blocksize);
 #endif
     }
+    // an L1 miss stream only covers L1 itself: anything that makes a hit or
+    // a miss in L1 more than that isn't in it
+    if (caches[0]->filterout || caches[0]->prefiltered) {
+        if (caches[0]->filterout && caches[0]->prefiltered)
+            error (configError, false, "Can't filter a prefiltered trace", __LINE__, __FILE__);
+        for (int i = 0; i < NTLBKINDS; i++)
+            if (caches[0]->tlbentries[i])
+                error (configError, false, "L1 filtering can't be combined with TLBs",
+                       __LINE__, __FILE__);
+        for (int i = 0; i < (caches[0]->split?2:1); i++)
+            if (caches[i]->victimblocks || caches[i]->slices > 1)
+                error (configError, false,
+                       "L1 filtering needs L1 without a victim cache or slices",
+                       __LINE__, __FILE__);
+    }
 }
 
+// sized for parameters from every line, and strings in options no longer than
+// the lines they are on
 CacheSetupT** getconfig (char **configlines) {
-    CacheSetupT** setup = NULL;
+    int Nlines = 0;
+    size_t bytes = 0;
+    for (; configlines[Nlines]; Nlines++)
+        bytes += arenabytes (sizeof(CacheSetupT)) + arenabytes (strlen (configlines[Nlines])+1);
+    ArenaT *arena = initarena (bytes + arenabytes (sizeof(CacheSetupT*)*(Nlines+1)));
+    CacheSetupT** setup = arenaalloc (arena, sizeof(CacheSetupT*)*(Nlines+1));
+    int Nparameters = 0;
     for (int i = 0; configlines[i]; i++)
-         setup = addCacheParameters (setup, makeCacheParametersStr(configlines[i]));
+         if (istlbline (configlines[i]))
+             addTLB (Nparameters?setup[0]:NULL, configlines[i]);
+         else if (isvictimline (configlines[i]))
+             addVictimCache (Nparameters?setup[Nparameters-1]:NULL, configlines[i]);
+         else
+             setup[Nparameters++] = makeCacheParametersStr (configlines[i], arena);
+    setup[Nparameters] = NULL; // mark the end
+    if (!Nparameters) {
+        deconstruct_arena (&arena);
+        return NULL;
+    }
     return setup;
 }
 
 void deconstruct_setup (CacheSetupT * caches []) {
-    for (int i = 0; caches[i]; i++) // stop on NULL
-        free (caches[i]);
-    free (caches);
+    ArenaT *arena = caches[0]->arena; // in the arena, so copy before freeing it
+    deconstruct_arena (&arena);
 }
 
 
@@ -181,3 +412,115 @@ CacheAssociativityT getSetupAssociativity (CacheSetupT *setup) {
 bool getSetupSplit (CacheSetupT *setup) {
    return setup->split;
 }
+
+InclusionT getSetupInclusion (CacheSetupT *setup) {
+   return setup->inclusion;
+}
+
+CachesizeT getSetupVictimblocks (CacheSetupT *setup) {
+   return setup->victimblocks;
+}
+
+LatencyT getSetupVictimhittime (CacheSetupT *setup) {
+   return setup->victimhittime;
+}
+
+IndexfunctionT getSetupIndexfunction (CacheSetupT *setup) {
+   return setup->indexfunction;
+}
+
+unsigned getSetupSlices (CacheSetupT *setup) {
+   return setup->slices;
+}
+
+unsigned getSetupSlicewindow (CacheSetupT *setup) {
+   return setup->slicewindow;
+}
+
+CachesizeT getSetupTLBentries (CacheSetupT *setup, TLBkindT which) {
+   return setup->tlbentries[which];
+}
+
+CacheAssociativityT getSetupTLBassociativity (CacheSetupT *setup, TLBkindT which) {
+   return setup->tlbassociativity[which];
+}
+
+LatencyT getSetupTLBhittime (CacheSetupT *setup, TLBkindT which) {
+   return setup->tlbhittime[which];
+}
+
+PagesizeT getSetupPagesize (CacheSetupT *setup) {
+   return setup->pagesize;
+}
+
+char *getSetupFilterout (CacheSetupT *setup) {
+   return setup->filterout;
+}
+
+bool getSetupPrefiltered (CacheSetupT *setup) {
+   return setup->prefiltered;
+}
+
+unsigned long getSetupSeed (CacheSetupT *setup) {
+   return setup->seed;
+}
+
+void setSetupSeed (CacheSetupT *setup, unsigned long seed) {
+   setup->seed = seed;
+}
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+// true if the name part of an option, namelength chars long, is the given name
+static bool isoption (char *option, size_t namelength, const char *name) {
+    return namelength == strlen (name) && !strncmp (option, name, namelength);
+}
+
+// apply an option of the form name=value to a set of parameters; false if
+// the name or value is not recognized
+static bool setoption (CacheSetupT *setup, char *option) {
+    char *value = strchr (option, '=');
+    if (!value)
+        return false;
+    size_t namelength = value - option;
+    value++;
+    if (isoption (option, namelength, "inclusion")) {
+        for (int i = 0; i < Ninclusionnames; i++)
+            if (!strcmp (value, inclusionnames[i])) {
+                setup->inclusion = i;
+                return true;
+            }
+    } else if (isoption (option, namelength, "index")) {
+        for (int i = 0; i < Nindexnames; i++)
+            if (!strcmp (value, indexnames[i])) {
+                setup->indexfunction = i;
+                return true;
+            }
+    } else if (isoption (option, namelength, "slices") ||
+               isoption (option, namelength, "slicewindow")) {
+        char *end;
+        unsigned long number = strtoul (value, &end, 10);
+        if (*end || !number)
+            return false;
+        if (isoption (option, namelength, "slices"))
+            setup->slices = number;
+        else
+            setup->slicewindow = number;
+        return true;
+    } else if (isoption (option, namelength, "filterout") && *value) {
+        setup->filterout = strcpy (arenaalloc (setup->arena, strlen (value)+1), value);
+        return true;
+    } else if (isoption (option, namelength, "prefiltered") &&
+               (!strcmp (value, "0") || !strcmp (value, "1"))) {
+        setup->prefiltered = *value == '1';
+        return true;
+    } else if (isoption (option, namelength, "seed")) {
+        char *end;
+        unsigned long number = strtoul (value, &end, 10);
+        if (*end || !*value)
+            return false;
+        setup->seed = number;
+        return true;
+    }
+    return false;
+}
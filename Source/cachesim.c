@@ -29,28 +29,73 @@
 #include "get_args.h"
 #include "simulateMultilevelAssoc.h"
 #include "workload.h"
+#include "configfile.h"
+#include "stringutils.h"
+#include "tracefile.h"
+#include "arena.h"
+#include "serve.h"
 #include "error.h"
 
+#include <stdio.h>
+
 
 int main (int argc, char *argv []) {
     // check command line and get config file ready to read
-    char** configlines = get_args (argc, argv);
-    // if good, read the workload file list (from stdin)
+    OptionsT options;
+    char** configlines = get_args (argc, argv, &options);
+    // server mode: cachesim --serve <socket path> <configuration file>
+    if (options.socketpath)
+        return serve (options.socketpath, options.configfile);
     if (!configlines)
        error (configFileError, false, "Configuration file missing or not openable",
               __LINE__, __FILE__);
-    if (!init_workloads ())
+    settracethreads (options.threads);
+    settraceformat (options.traceformat);
+    setarenalimit (options.memorylimit);
+    // if good, read the workload file list (from stdin unless given a file)
+    FILE *list = options.workloadfile ? fopen (options.workloadfile, "r") : stdin;
+    if (!list)
+       error (workloadError, false, options.workloadfile, __LINE__, __FILE__);
+    if (!init_workloads (list))
        error (workloadError, false, "No usable workload files", __LINE__, __FILE__);
-    // initialize main data structures
-    CacheSetupT** parameters = 
-    // read cache config from file name in command line
-        getconfig (configlines);
-    reportParameters (parameters);
-    
-    // run simulation
-    simulateMultilevelAssoc (parameters);
-    // report stats
+    if (list != stdin)
+       fclose (list);
+    // one configuration, or each point of a sweep in turn over the same workload
+    ConfigsweepT *sweep = initsweep (configlines);
+    dispose_lines (configlines);
+    ReportT *report = initreport (options.format, stdout);
+    for (int point = 0; point < sweeppoints (sweep); point++) {
+        if (point && !rewind_workloads ())
+           error (workloadError, false, "Workload files not reopenable", __LINE__, __FILE__);
+        // initialize main data structures
+        configlines = sweepconfig (sweep, point);
+        CacheSetupT** parameters = getconfig (configlines);
+        dispose_lines (configlines);
+        if (options.seeded)
+            setSetupSeed (parameters[0], options.seed);
+        const char *name, *value;
+        if (report && sweeppoints (sweep) > 1)
+            reportsweep (report, point);
+        else if (sweeppoints (sweep) > 1) {
+            printf ("sweep [%d]", point);
+            for (int i = 0; sweepsetting (sweep, point, i, &name, &value); i++)
+                printf (" %s=%s", name, value);
+            printf ("\n");
+        }
+        if (report) {
+            reportParametersTo (parameters, report);
+            for (int i = 0; sweepsetting (sweep, point, i, &name, &value); i++)
+                reportstring (report, "sweep", "", name, value);
+        } else
+            reportParameters (parameters);
+
+        // run simulation
+        simulateMultilevelAssoc (parameters, &options.run, report);
+        deconstruct_setup (parameters);
+    }
+    if (report)
+        finishreport (&report);
     // deconstruct data structures
-    deconstruct_setup (parameters);
+    deconstruct_sweep (&sweep);
     deconstruct_workload ();
 }
@@ -0,0 +1,475 @@
+/*
+ * configfile.c
+ *
+ * A configuration file in either format (see configfile.h). A list of
+ * settings is kept as each setting's values, more than one if swept; a point
+ * of the sweep picks one value of each, found by counting in mixed radix with
+ * the point as the number, and is written out as the usual lines of numbers.
+ *
+ */
+
+#include "configfile.h"
+#include "stringutils.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+#define MAXLEVELS  16   // l1 to l16
+#define MAXSETTING 128  // longest section.name
+
+typedef struct {
+    char name [MAXSETTING]; // section.key, in lower case
+    char **values;          // more than one if swept
+    int Nvalues;
+} SettingT;
+
+struct Configsweep {
+    char **numberlines;     // lines of numbers as given; NULL if settings
+    SettingT *settings;
+    int Nsettings,
+        Npoints;
+}; // typedef ConfigsweepT
+
+// what each kind of section may set: NULL-terminated lists
+static const char *levelkeys [] = {"size", "block", "hit", "lookup", "assoc", "index",
+                                   "slices", "slicewindow", "victim", "victimhit",
+                                   "replacement", "write", "prefetch", NULL},
+                  *dramkeys [] = {"hit", NULL},
+                  *tlbkeys [] = {"entries", "assoc", "hit", "page", NULL},
+                  *hierarchykeys [] = {"inclusion", "seed", "filterout", "prefiltered", NULL};
+
+// in the same order as TLBkindT (cachesetup.h)
+static const char *tlbsections [] = {"itlb", "dtlb", "stlb"};
+
+#define NTLBSECTIONS (sizeof (tlbsections) / sizeof (const char *))
+
+// policies that can be named, with the only one simulated
+static const char *policykeys [] = {"replacement", "write", "prefetch"},
+                  *policies [] = {"random", "writeback", "none"};
+
+#define NPOLICIES (sizeof (policies) / sizeof (const char *))
+
+
+//////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
+
+// true if any line is a section or a setting rather than numbers
+static bool issettings (char **configlines);
+
+// add a line name=value, in section unless name has its own
+static void addsetting (ConfigsweepT *sweep, const char *section, char *line);
+
+// the values of a setting: one, or those of a list or range
+static void expandvalue (SettingT *setting, char *value);
+
+// the settings a section may have; NULL if there is no such section
+static const char **keysfor (const char *section);
+
+// a level section's level (1 for l1, l1i and l1d); 0 if not a level
+static int levelof (const char *section);
+
+static bool hassection (ConfigsweepT *sweep, const char *section);
+
+// the value of section.key at a point (given as the value chosen of each
+// setting); NULL if not set
+static const char *valueat (ConfigsweepT *sweep, const int *chosen,
+                            const char *section, const char *key);
+
+// the same as a number: if not set, an error if needed, else otherwise
+static unsigned long numberat (ConfigsweepT *sweep, const int *chosen, const char *section,
+                               const char *key, bool needed, unsigned long otherwise);
+
+// a level's line of numbers and options, and its victim cache line if any
+static void writelevel (FILE *out, ConfigsweepT *sweep, const int *chosen,
+                        const char *section, bool split, bool first);
+
+// section.key as an option of the usual format, if set
+static void writeoption (FILE *out, ConfigsweepT *sweep, const int *chosen,
+                         const char *section, const char *key);
+
+// a number with an optional K, M or G; false if not one
+static bool getnumber (const char *text, unsigned long *number);
+
+// a number as text, with the biggest of K, M or G that divides it exactly
+static char *numbertext (unsigned long number);
+
+// text from start to end without spaces either side, in a new string
+static char *trimmed (const char *start, const char *end);
+
+static void configerror (const char *text, const char *detail, unsigned linenumber);
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+ConfigsweepT *initsweep (char **configlines) {
+    ConfigsweepT *sweep = calloc (1, sizeof (ConfigsweepT));
+    int Nlines = lineslen (configlines);
+    sweep->Npoints = 1;
+    if (!issettings (configlines)) {
+        sweep->numberlines = malloc (sizeof (char*) * (Nlines+1));
+        for (int i = 0; i <= Nlines; i++)
+            sweep->numberlines[i] = configlines[i] ? strdup (configlines[i]) : NULL;
+        return sweep;
+    }
+    sweep->settings = calloc (Nlines, sizeof (SettingT));
+    char *section = strdup ("hierarchy");
+    for (int i = 0; i < Nlines; i++) {
+        char *line = configlines[i];
+        while (isspace ((unsigned char) *line))
+            line++;
+        if (!*line || *line == '#' || *line == ';')
+            continue;
+        if (*line == '[') {
+            char *close = strchr (line, ']');
+            if (!close)
+                configerror ("section not closed", line, __LINE__);
+            free (section);
+            section = trimmed (line+1, close);
+            for (char *c = section; *c; c++)
+                *c = tolower ((unsigned char) *c);
+            if (!keysfor (section))
+                configerror ("no such section", section, __LINE__);
+        } else
+            addsetting (sweep, section, line);
+    }
+    free (section);
+    // policies other than those simulated are named but not taken
+    for (int i = 0; i < sweep->Nsettings; i++)
+        for (int policy = 0; policy < NPOLICIES; policy++) {
+            const char *key = strrchr (sweep->settings[i].name, '.') + 1;
+            if (strcmp (key, policykeys[policy]))
+                continue;
+            for (int value = 0; value < sweep->settings[i].Nvalues; value++)
+                if (strcmp (sweep->settings[i].values[value], policies[policy]))
+                    configerror ("policy not simulated", sweep->settings[i].values[value],
+                                 __LINE__);
+        }
+    for (int i = 0; i < sweep->Nsettings; i++) {
+        if (sweep->Npoints * (long) sweep->settings[i].Nvalues > MAXSWEEPPOINTS)
+            configerror ("sweep has too many points", sweep->settings[i].name, __LINE__);
+        sweep->Npoints *= sweep->settings[i].Nvalues;
+    }
+    return sweep;
+}
+
+int sweeppoints (ConfigsweepT *sweep) {
+    return sweep->Npoints;
+}
+
+char **sweepconfig (ConfigsweepT *sweep, int point) {
+    char *buffer = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream (&buffer, &length);
+    if (sweep->numberlines) {
+        for (int i = 0; sweep->numberlines[i]; i++)
+            fprintf (out, "%s\n", sweep->numberlines[i]);
+        fclose (out);
+        return linify (buffer);
+    }
+    // the value chosen of each setting: the last varies fastest
+    int chosen [sweep->Nsettings];
+    for (int i = sweep->Nsettings-1; i >= 0; i--) {
+        chosen[i] = point % sweep->settings[i].Nvalues;
+        point /= sweep->settings[i].Nvalues;
+    }
+    bool split = hassection (sweep, "l1i") || hassection (sweep, "l1d");
+    if (split && !(hassection (sweep, "l1i") && hassection (sweep, "l1d")))
+        configerror ("split L1 needs both l1i and l1d", NULL, __LINE__);
+    if (split == hassection (sweep, "l1"))
+        configerror ("need either l1, or l1i and l1d", NULL, __LINE__);
+    if (!hassection (sweep, "dram"))
+        configerror ("need dram", NULL, __LINE__);
+    writelevel (out, sweep, chosen, split ? "l1i" : "l1", split, true);
+    if (split)
+        writelevel (out, sweep, chosen, "l1d", false, false);
+    // the levels below in order, with none missing
+    int lowest = 1;
+    for (int i = 0; i < sweep->Nsettings; i++) {
+        char section [MAXSETTING];
+        sscanf (sweep->settings[i].name, "%[^.]", section);
+        if (levelof (section) > lowest)
+            lowest = levelof (section);
+    }
+    for (int level = 2; level <= lowest; level++) {
+        char section [MAXSETTING];
+        snprintf (section, MAXSETTING, "l%d", level);
+        if (!hassection (sweep, section))
+            configerror ("levels must go down from l1 without a gap at", section, __LINE__);
+        writelevel (out, sweep, chosen, section, false, false);
+    }
+    fprintf (out, "0 0 %lu 0 0 0\n", numberat (sweep, chosen, "dram", "hit", true, 0));
+    for (int i = 0; i < NTLBSECTIONS; i++) {
+        if (!hassection (sweep, tlbsections[i]))
+            continue;
+        const char *page = valueat (sweep, chosen, tlbsections[i], "page");
+        fprintf (out, "tlb %c %lu %lu %lu%s%s\n", toupper (tlbsections[i][0]),
+                 numberat (sweep, chosen, tlbsections[i], "entries", true, 0),
+                 numberat (sweep, chosen, tlbsections[i], "assoc", true, 0),
+                 numberat (sweep, chosen, tlbsections[i], "hit", false, 0),
+                 page ? " page=" : "", page ? page : "");
+    }
+    fclose (out);
+    return linify (buffer);
+}
+
+bool sweepsetting (ConfigsweepT *sweep, int point, int i,
+                   const char **name, const char **value) {
+    // as in sweepconfig, but only settings swept count
+    int swept = 0, Nswept = 0;
+    for (int setting = 0; setting < sweep->Nsettings; setting++)
+        Nswept += sweep->settings[setting].Nvalues > 1;
+    for (int setting = sweep->Nsettings-1; setting >= 0; setting--) {
+        SettingT *this = &sweep->settings[setting];
+        int choice = point % this->Nvalues;
+        point /= this->Nvalues;
+        if (this->Nvalues > 1 && Nswept - ++swept == i) {
+            *name = this->name;
+            *value = this->values[choice];
+            return true;
+        }
+    }
+    return false;
+}
+
+void deconstruct_sweep (ConfigsweepT **sweep) {
+    if ((*sweep)->numberlines) {
+        for (int i = 0; (*sweep)->numberlines[i]; i++)
+            free ((*sweep)->numberlines[i]);
+        free ((*sweep)->numberlines);
+    }
+    for (int i = 0; i < (*sweep)->Nsettings; i++) {
+        for (int value = 0; value < (*sweep)->settings[i].Nvalues; value++)
+            free ((*sweep)->settings[i].values[value]);
+        free ((*sweep)->settings[i].values);
+    }
+    free ((*sweep)->settings);
+    free (*sweep);
+    *sweep = NULL;
+}
+
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+static bool issettings (char **configlines) {
+    for (int i = 0; configlines[i]; i++) {
+        char *line = configlines[i];
+        while (isspace ((unsigned char) *line))
+            line++;
+        size_t first = strcspn (line, " \t\r");
+        if (*line == '[' || memchr (line, '=', first))
+            return true;
+    }
+    return false;
+}
+
+static void addsetting (ConfigsweepT *sweep, const char *section, char *line) {
+    char *equals = strchr (line, '=');
+    if (!equals)
+        configerror ("not a setting", line, __LINE__);
+    char *key = trimmed (line, equals), *value = trimmed (equals+1, equals+1+strlen (equals+1));
+    char name [MAXSETTING];
+    if (strchr (key, '.'))
+        snprintf (name, MAXSETTING, "%s", key);
+    else
+        snprintf (name, MAXSETTING, "%s.%s", section, key);
+    free (key);
+    for (char *c = name; *c; c++)
+        *c = tolower ((unsigned char) *c);
+    // the section and key must be known
+    char *dot = strrchr (name, '.');
+    *dot = '\0';
+    const char **keys = keysfor (name);
+    if (!keys)
+        configerror ("no such section", name, __LINE__);
+    int i;
+    for (i = 0; keys[i] && strcmp (keys[i], dot+1); i++) ;
+    *dot = '.';
+    if (!keys[i] || !*value)
+        configerror ("not a setting", name, __LINE__);
+    // a later setting of the same name replaces an earlier one
+    SettingT *setting = &sweep->settings[sweep->Nsettings];
+    for (i = 0; i < sweep->Nsettings; i++)
+        if (!strcmp (sweep->settings[i].name, name)) {
+            setting = &sweep->settings[i];
+            for (int old = 0; old < setting->Nvalues; old++)
+                free (setting->values[old]);
+            free (setting->values);
+            break;
+        }
+    if (i == sweep->Nsettings)
+        sweep->Nsettings++;
+    strcpy (setting->name, name);
+    expandvalue (setting, value);
+    free (value);
+}
+
+static void expandvalue (SettingT *setting, char *value) {
+    char *dots = strstr (value, "..");
+    unsigned long first, last, step;
+    if (dots) {
+        *dots = '\0';
+        bool range = getnumber (value, &first);
+        *dots = '.';
+        if (range) { // first..last*factor or first..last+step
+            char *op = dots + 2 + strcspn (dots+2, "*+"), kind = *op;
+            *op = '\0';
+            if (!kind || !getnumber (dots+2, &last) || !getnumber (op+1, &step) ||
+                first > last || (kind == '*' ? step < 2 || !first : !step))
+                configerror ("not a range", setting->name, __LINE__);
+            setting->Nvalues = 0;
+            setting->values = malloc (sizeof (char*) * MAXSWEEPPOINTS);
+            for (unsigned long number = first; number <= last;
+                 number = kind == '*' ? number * step : number + step) {
+                if (setting->Nvalues == MAXSWEEPPOINTS)
+                    configerror ("sweep has too many points", setting->name, __LINE__);
+                setting->values[setting->Nvalues++] = numbertext (number);
+            }
+            return;
+        }
+    }
+    // a list, or a single value: a list of one
+    setting->Nvalues = 1;
+    for (char *c = value; *c; c++)
+        setting->Nvalues += *c == ',';
+    setting->values = malloc (sizeof (char*) * setting->Nvalues);
+    char *start = value;
+    for (int i = 0; i < setting->Nvalues; i++) {
+        char *end = start + strcspn (start, ",");
+        setting->values[i] = trimmed (start, end);
+        if (!*setting->values[i])
+            configerror ("empty value in", setting->name, __LINE__);
+        start = end + 1;
+    }
+}
+
+static const char **keysfor (const char *section) {
+    if (levelof (section))
+        return levelkeys;
+    if (!strcmp (section, "dram"))
+        return dramkeys;
+    if (!strcmp (section, "hierarchy"))
+        return hierarchykeys;
+    for (int i = 0; i < NTLBSECTIONS; i++)
+        if (!strcmp (section, tlbsections[i]))
+            return tlbkeys;
+    return NULL;
+}
+
+static int levelof (const char *section) {
+    if (!strcmp (section, "l1i") || !strcmp (section, "l1d"))
+        return 1;
+    char *end;
+    if (section[0] != 'l' || !isdigit ((unsigned char) section[1]))
+        return 0;
+    long level = strtol (section+1, &end, 10);
+    return *end || level < 1 || level > MAXLEVELS ? 0 : level;
+}
+
+static bool hassection (ConfigsweepT *sweep, const char *section) {
+    size_t length = strlen (section);
+    for (int i = 0; i < sweep->Nsettings; i++)
+        if (!strncmp (sweep->settings[i].name, section, length) &&
+            sweep->settings[i].name[length] == '.')
+            return true;
+    return false;
+}
+
+static const char *valueat (ConfigsweepT *sweep, const int *chosen,
+                            const char *section, const char *key) {
+    char name [MAXSETTING];
+    snprintf (name, MAXSETTING, "%s.%s", section, key);
+    for (int i = 0; i < sweep->Nsettings; i++)
+        if (!strcmp (sweep->settings[i].name, name))
+            return sweep->settings[i].values[chosen[i]];
+    return NULL;
+}
+
+static unsigned long numberat (ConfigsweepT *sweep, const int *chosen, const char *section,
+                               const char *key, bool needed, unsigned long otherwise) {
+    const char *value = valueat (sweep, chosen, section, key);
+    unsigned long number = otherwise;
+    char name [MAXSETTING];
+    snprintf (name, MAXSETTING, "%s.%s", section, key);
+    if (!value && needed)
+        configerror ("missing setting", name, __LINE__);
+    if (value && !getnumber (value, &number))
+        configerror ("not a number", name, __LINE__);
+    return number;
+}
+
+static void writelevel (FILE *out, ConfigsweepT *sweep, const int *chosen,
+                        const char *section, bool split, bool first) {
+    fprintf (out, "%lu %lu %lu %lu %lu %d",
+             numberat (sweep, chosen, section, "size", true, 0),
+             numberat (sweep, chosen, section, "block", true, 0),
+             numberat (sweep, chosen, section, "hit", true, 0),
+             numberat (sweep, chosen, section, "lookup", false, 0),
+             numberat (sweep, chosen, section, "assoc", false, 1), split);
+    // the options of the usual format, the hierarchy's on the first line; those
+    // that are numbers without K, M or G, which the usual format doesn't take
+    static const char *options [] = {"index", "slices", "slicewindow"};
+    for (int i = 0; i < sizeof (options) / sizeof (const char *); i++)
+        writeoption (out, sweep, chosen, section, options[i]);
+    for (int i = 0; first && hierarchykeys[i]; i++)
+        writeoption (out, sweep, chosen, "hierarchy", hierarchykeys[i]);
+    fprintf (out, "\n");
+    if (valueat (sweep, chosen, section, "victim"))
+        fprintf (out, "victim %lu %lu\n",
+                 numberat (sweep, chosen, section, "victim", true, 0),
+                 numberat (sweep, chosen, section, "victimhit", false, 0));
+}
+
+static void writeoption (FILE *out, ConfigsweepT *sweep, const int *chosen,
+                         const char *section, const char *key) {
+    const char *value = valueat (sweep, chosen, section, key);
+    if (value && (!strcmp (key, "slices") || !strcmp (key, "slicewindow") ||
+                  !strcmp (key, "seed")))
+        fprintf (out, " %s=%lu", key, numberat (sweep, chosen, section, key, true, 0));
+    else if (value)
+        fprintf (out, " %s=%s", key, value);
+}
+
+static bool getnumber (const char *text, unsigned long *number) {
+    char *end;
+    if (!isdigit ((unsigned char) *text))
+        return false;
+    *number = strtoul (text, &end, 10);
+    if (*end && strchr ("kKmMgG", *end))
+        *number <<= strchr ("kK", *end++) ? 10 : strchr ("mM", end[-1]) ? 20 : 30;
+    return !*end;
+}
+
+static char *numbertext (unsigned long number) {
+    static const char *suffixes = "GMK";
+    char text [32];
+    for (int i = 0; i < 3; i++) {
+        unsigned long unit = 1ul << (30 - 10*i);
+        if (number && number % unit == 0) {
+            snprintf (text, sizeof (text), "%lu%c", number / unit, suffixes[i]);
+            return strdup (text);
+        }
+    }
+    snprintf (text, sizeof (text), "%lu", number);
+    return strdup (text);
+}
+
+static char *trimmed (const char *start, const char *end) {
+    while (start < end && isspace ((unsigned char) *start))
+        start++;
+    while (end > start && isspace ((unsigned char) end[-1]))
+        end--;
+    return strndup (start, end - start);
+}
+
+static void configerror (const char *text, const char *detail, unsigned linenumber) {
+    char message [2*MAXSETTING];
+    snprintf (message, sizeof (message), "%s%s%s", text, detail ? ": " : "",
+              detail ? detail : "");
+    error (configError, false, message, linenumber, __FILE__);
+}
@@ -0,0 +1,193 @@
+/*
+ * deltatrace.c
+ *
+ * Compact binary trace format: per-type delta streams of zigzag varints with
+ * run records for constant-stride sequences; see deltatrace.h for the layout.
+ *
+ */
+
+#include "deltatrace.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+// record types in the order of their codes; B and V are the writebacks and clean
+// victims of an L1-filtered trace
+#define DELTATYPES "IRWXBV"
+#define NDELTATYPES (sizeof (DELTATYPES) - 1)
+#define TYPEBITS 3
+#define RUNBIT   (1 << TYPEBITS)
+#define HEADSHIFT (TYPEBITS + 1)
+
+struct DeltaEncoder {
+    FILE *file;
+    unsigned last [NDELTATYPES];  // last address written of each type
+    Trace run;                   // held back in case more references continue it
+    bool held;
+}; // typedef DeltaEncoderT
+
+struct DeltaDecoder {
+    unsigned last [NDELTATYPES];
+}; // typedef DeltaDecoderT
+
+
+//////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
+
+// write the held record
+static void flushrun (DeltaEncoderT *encoder);
+
+static int typecode (ReftypeT reftype);
+
+static uint64_t zigzag (int32_t value);
+static int32_t unzigzag (uint64_t value);
+
+static void putvarint (FILE *file, uint64_t value);
+
+// decode a varint from bytes up to end, moving *bytes past it; false if incomplete
+static bool getvarint (const unsigned char **bytes, const unsigned char *end,
+                       uint64_t *value);
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+DeltaEncoderT* initdeltaencoder (FILE *file) {
+    DeltaEncoderT *encoder = calloc (1, sizeof (DeltaEncoderT));
+    encoder->file = file;
+    fwrite (DELTAMAGIC, 1, DELTAMAGICLENGTH, file);
+    return encoder;
+}
+
+void deltaencode (DeltaEncoderT *encoder, Trace record) {
+    Trace *run = &encoder->run;
+    if (encoder->held && record.reftype == run->reftype && record.reftype != EXCEPTION) {
+        // the second reference sets the stride, later ones must keep to it
+        if (run->count == 1) {
+            run->stride = record.addr - run->addr;
+            run->count++;
+            return;
+        }
+        if (record.addr - (run->addr + (run->count-1)*run->stride) == run->stride) {
+            run->count++;
+            return;
+        }
+    }
+    if (encoder->held)
+        flushrun (encoder);
+    *run = record;
+    run->count = 1;
+    run->stride = 0;
+    encoder->held = true;
+}
+
+void finishdeltaencoder (DeltaEncoderT **encoder) {
+    if ((*encoder)->held)
+        flushrun (*encoder);
+    putvarint ((*encoder)->file, RUNBIT); // run of 0: end of trace
+    putvarint ((*encoder)->file, 0);
+    putvarint ((*encoder)->file, 0);
+    free (*encoder);
+    *encoder = NULL;
+}
+
+DeltaDecoderT* initdeltadecoder () {
+    return calloc (1, sizeof (DeltaDecoderT));
+}
+
+void deconstruct_deltadecoder (DeltaDecoderT **decoder) {
+    free (*decoder);
+    *decoder = NULL;
+}
+
+int deltadecode (DeltaDecoderT *decoder, const unsigned char *bytes, size_t length,
+                 Trace *record) {
+    const unsigned char *p = bytes, *end = bytes + length;
+    uint64_t head, count = 1, stride = 0;
+    if (!getvarint (&p, end, &head))
+        return length < MAXDELTARECORD ? 0 : DELTACORRUPT;
+    int type = head & (RUNBIT-1);
+    if (head & RUNBIT) {
+        if (!getvarint (&p, end, &count) || !getvarint (&p, end, &stride))
+            return length < MAXDELTARECORD ? 0 : DELTACORRUPT;
+        if (!count)
+            return DELTAEND;
+        if (count > UINT32_MAX)
+            return DELTACORRUPT;
+    }
+    if (type >= NDELTATYPES)
+        return DELTACORRUPT;
+    record->reftype = DELTATYPES[type];
+    record->count = count;
+    record->stride = unzigzag (stride);
+    record->size = 0;
+    unsigned base = record->reftype == EXCEPTION ? 0 : decoder->last[type];
+    record->addr = base + unzigzag (head >> HEADSHIFT);
+    if (record->reftype != EXCEPTION)
+        decoder->last[type] = record->addr + (record->count-1)*record->stride;
+    return p - bytes;
+}
+
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+static void flushrun (DeltaEncoderT *encoder) {
+    Trace *run = &encoder->run;
+    int type = typecode (run->reftype);
+    unsigned base = run->reftype == EXCEPTION ? 0 : encoder->last[type];
+    uint64_t head = zigzag (run->addr - base) << HEADSHIFT | type;
+    if (run->count > 1) {
+        putvarint (encoder->file, head | RUNBIT);
+        putvarint (encoder->file, run->count);
+        putvarint (encoder->file, zigzag (run->stride));
+    } else
+        putvarint (encoder->file, head);
+    if (run->reftype != EXCEPTION)
+        encoder->last[type] = run->addr + (run->count-1)*run->stride;
+    encoder->held = false;
+}
+
+static int typecode (ReftypeT reftype) {
+    const char *code = strchr (DELTATYPES, reftype);
+    if (!reftype || !code)
+        error (traceError, false, "record type can't be delta encoded",
+               __LINE__, __FILE__);
+    return code - DELTATYPES;
+}
+
+static uint64_t zigzag (int32_t value) {
+    return (uint32_t) ((uint32_t) value << 1 ^ (uint32_t) (value >> 31));
+}
+
+static int32_t unzigzag (uint64_t value) {
+    return (int32_t) ((uint32_t) (value >> 1) ^ -(uint32_t) (value & 1));
+}
+
+static void putvarint (FILE *file, uint64_t value) {
+    unsigned char bytes [10];
+    int N = 0;
+    do {
+        bytes[N++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        value >>= 7;
+    } while (value);
+    fwrite (bytes, 1, N, file);
+}
+
+static bool getvarint (const unsigned char **bytes, const unsigned char *end,
+                       uint64_t *value) {
+    const unsigned char *p = *bytes;
+    uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        result |= (uint64_t) (*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            *value = result;
+            *bytes = p;
+            return true;
+        }
+    }
+    return false;
+}
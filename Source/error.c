@@ -24,11 +24,22 @@ const char * errorstrings [] = {
    "Improperly formatted cache configuration line",
    "Unable to find or open cache configuration line",
    "Unable to open workload file",
-   "Invalid number of levels setting up stats"
+   "Invalid number of levels setting up stats",
+   "Unable to start a thread",
+   "Bad trace or unable to write trace file",
+   "Server unable to use socket",
+   "Unable to allocate memory"
 };
 
 #define Nerrors (sizeof (errorstrings) / sizeof (const char *))
 
+// per thread, as simulators in separate threads each set their own
+static _Thread_local jmp_buf *errorjump = NULL;
+
+void errortrap (jmp_buf *trap) {
+    errorjump = trap;
+}
+
 void error (unsigned errorcode, bool noexit, char* text,
             unsigned linenumber, char* filename) {
    fprintf (stderr, "ERROR");
@@ -43,6 +54,8 @@ void error (unsigned errorcode, bool noexit, char* text,
    if (filename)
       fprintf (stderr, " in source file `%s'", filename);
    fprintf (stderr, "\n");
+   if (!noexit && errorjump)
+     longjmp (*errorjump, errorcode+1);
    if (!noexit)
      exit (errorcode);
    else
@@ -2,7 +2,8 @@
  *
  * Check command line and print usage if wrong; if right
  * open config file, read it in and convert to array
- * of strings, one per line.
+ * of strings, one per line. Options are parsed with getopt_long
+ * into an OptionsT (see get_args.h).
  *
  * Author:   Philip Machanick
  * Created:  11 April 2012
@@ -18,14 +19,46 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <getopt.h>
 
 
 static const char pathseparator = '/';
 
-static const char* usage = "USAGE: %s configfilename\n"
+static const char* usage = "USAGE: %s [options] configfilename\n"
+  "       or:  %s --serve socketpath configfilename\n"
   "       reads a trace file simulating a cache, counting hits and misses.\n"
-  "       If more than one trace file is given, the cache is flushed but\n"
-  "       counts are not reset.\n"
+  "options:\n"
+  "  -w, --workload=FILE       read the list of trace files from FILE, not stdin\n"
+  "  -f, --format=text|json|csv\n"
+  "                            with json or csv the configuration and every\n"
+  "                            count by level and type of reference are output\n"
+  "                            in that format instead of the tables\n"
+  "      --flush               between trace files flush the cache but carry\n"
+  "                            on counting (default: start each as new)\n"
+  "      --warm                between trace files reset the counts but keep\n"
+  "                            the cache's contents\n"
+  "      --warmup=N            only count after the first N references of each\n"
+  "                            trace (not with --flush)\n"
+  "  -i, --interval=N          also report the stats every N references\n"
+  "      --sample=N            simulate 1 in N windows of %d references, for\n"
+  "                            an estimate in a fraction of the time\n"
+  "      --schedule=roundrobin|exception\n"
+  "                            interleave the traces as processes sharing the\n"
+  "                            hierarchy, switching after a quantum, or at an\n"
+  "                            exception, which waits its count of references\n"
+  "      --quantum=N           references a process runs before a switch\n"
+  "                            (default %d for roundrobin, none for exception)\n"
+  "      --attribute           count each level's hits, misses and evictions by\n"
+  "                            the trace owning the block and the one referring\n"
+  "      --occupancy=N         also sample each trace's blocks every N references\n"
+  "  -s, --seed=N              seed replacement choices with N, not the\n"
+  "                            configuration file's seed\n"
+  "  -t, --trace-format=auto|text|delta|lackey|memtrace\n"
+  "                            read traces in this format (default: detected)\n"
+  "  -j, --threads=N           decode compressed traces with up to N threads\n"
+  "  -m, --memory-limit=N[k|m|g]\n"
+  "                            stop if the hierarchy needs more than N bytes\n"
+  "  -h, --help                print this and stop\n"
   "       The configuration file should specify cache levels as follows.\n"
   "         size in bytes\n"
   "         block size\n"
@@ -38,12 +71,44 @@ static const char* usage = "USAGE: %s configfilename\n"
   "       All sizes must be powers of 2 >= 1 and costs >= 0; lower level\n"
   "       cache sizes must be >= upper levels to support multilevel inclusion.\n"
   "       Except: DRAM specified as all zeros excewpt hit time.\n"
+  "       Or the file may be settings, INI style (e.g. l3.size=4M), any\n"
+  "       of which may sweep a list or range of values (l3.size=1M..64M*2),\n"
+  "       running every combination in turn.\n"
   "input:\n"
-  "       list of trace files (stdin)\n"
+  "       list of trace files (stdin unless --workload)\n"
   "output (stdout: X, Y and Z are calculated counts):\n"
   "      processed X memory references, Y misses; Z hits\n"
 ;
 
+// options without a short form
+enum {flushoption = 256, warmoption, warmupoption, sampleoption, scheduleoption,
+      quantumoption, attributeoption, occupancyoption, serveoption};
+
+static const struct option longoptions [] = {
+  {"workload",     required_argument, NULL, 'w'},
+  {"format",       required_argument, NULL, 'f'},
+  {"flush",        no_argument,       NULL, flushoption},
+  {"warm",         no_argument,       NULL, warmoption},
+  {"warmup",       required_argument, NULL, warmupoption},
+  {"interval",     required_argument, NULL, 'i'},
+  {"sample",       required_argument, NULL, sampleoption},
+  {"schedule",     required_argument, NULL, scheduleoption},
+  {"quantum",      required_argument, NULL, quantumoption},
+  {"attribute",    no_argument,       NULL, attributeoption},
+  {"occupancy",    required_argument, NULL, occupancyoption},
+  {"seed",         required_argument, NULL, 's'},
+  {"trace-format", required_argument, NULL, 't'},
+  {"threads",      required_argument, NULL, 'j'},
+  {"memory-limit", required_argument, NULL, 'm'},
+  {"serve",        required_argument, NULL, serveoption},
+  {"help",         no_argument,       NULL, 'h'},
+  {NULL, 0, NULL, 0}
+};
+
+static const char *formatnames [] = {"text", "json", "csv", NULL},
+                  *tracenames [] = {"auto", "text", "delta", "lackey", "memtrace", NULL},
+                  *schedulenames [] = {"none", "roundrobin", "exception", NULL};
+
 static void display_usage (char *progname, int die) {
   char *name_nopath = &progname[strlen(progname)-1];
   while (name_nopath > progname) {
@@ -53,33 +118,108 @@ static void display_usage (char *progname, int die) {
     }
     name_nopath --;
   }
-  fprintf(stderr, usage, name_nopath);
+  fprintf(stderr, usage, name_nopath, name_nopath, SAMPLEWINDOW, DEFAULTQUANTUM);
   if (die) {
     fprintf(stderr,"dying with %d\n", die);
     exit(die);
   }
 }
 
-char** get_args (int argc, char *argv[]) {
-  unsigned int namelength;
-  int i;
+// a number from an option's argument, which if scaled may end in k, m or g
+// (times 1024 each); usage if it isn't one
+static unsigned long getnumber (char *progname, const char *text, bool scaled) {
+  char *end;
+  unsigned long number = strtoul (text, &end, 0);
+  if (scaled && *end && strchr ("kKmMgG", *end)) {
+    int shift = strchr ("kK", *end) ? 10 : strchr ("mM", *end) ? 20 : 30;
+    number <<= shift;
+    end++;
+  }
+  if (end == text || *end || *text == '-') {
+    fprintf(stderr,"bad number `%s'\n", text);
+    display_usage(progname, -1);
+  }
+  return number;
+}
+
+// the index of text in a NULL-terminated list of names; usage if it isn't there
+static int getname (char *progname, const char *text, const char *names []) {
+  for (int i = 0; names[i]; i++)
+    if (!strcmp (text, names[i]))
+      return i;
+  fprintf(stderr,"bad choice `%s'\n", text);
+  display_usage(progname, -1);
+  return 0;
+}
+
+char** get_args (int argc, char *argv[], OptionsT *options) {
   long filelength = 0;
   char * buffer;
-  char ** lines;
-  if (argc != 2) {
-    fprintf(stderr,"bad argc = %d\n", argc);
+  int option;
+  bool quantumset = false;
+  memset (options, 0, sizeof (OptionsT));
+  while ((option = getopt_long (argc, argv, "w:f:i:s:t:j:m:h", longoptions, NULL)) != -1)
+    switch (option) {
+    case 'w': options->workloadfile = optarg; break;
+    case 'f': options->format = getname (argv[0], optarg, formatnames); break;
+    case flushoption: options->run.between = flushbetween; break;
+    case warmoption: options->run.between = warmbetween; break;
+    case warmupoption: options->run.warmup = getnumber (argv[0], optarg, true); break;
+    case 'i': options->run.interval = getnumber (argv[0], optarg, true); break;
+    case sampleoption: options->run.sample = getnumber (argv[0], optarg, false); break;
+    case scheduleoption:
+      options->run.schedule = getname (argv[0], optarg, schedulenames);
+      break;
+    case quantumoption:
+      quantumset = true;
+      options->run.quantum = getnumber (argv[0], optarg, true);
+      break;
+    case attributeoption: options->run.attribute = true; break;
+    case occupancyoption:
+      options->run.attribute = true;
+      options->run.occupancy = getnumber (argv[0], optarg, true);
+      break;
+    case 's':
+      options->seeded = true;
+      options->seed = getnumber (argv[0], optarg, false);
+      break;
+    case 't': options->traceformat = getname (argv[0], optarg, tracenames); break;
+    case 'j': options->threads = getnumber (argv[0], optarg, false); break;
+    case 'm': options->memorylimit = getnumber (argv[0], optarg, true); break;
+    case serveoption: options->socketpath = optarg; break;
+    case 'h': display_usage(argv[0], 0); exit(0);
+    default: display_usage(argv[0], -1); // getopt_long has said what was wrong
+    }
+  if (optind != argc-1) {
+    fprintf(stderr,"expected one configuration file, got %d\n", argc-optind);
+    display_usage(argv[0], -1);
+  }
+  if (options->run.warmup && options->run.between == flushbetween) {
+    fprintf(stderr,"--warmup would reset the counts --flush carries on\n");
+    display_usage(argv[0], -1);
+  }
+  if (options->run.schedule != noschedule &&
+      (options->run.between != resetbetween || options->run.warmup ||
+       options->run.interval || options->run.sample)) {
+    fprintf(stderr,"--schedule runs the traces together: no --flush, --warm, "
+            "--warmup, --interval or --sample\n");
     display_usage(argv[0], -1);
   }
-  FILE *infile = fopen (argv[1], "r");
+  if (options->run.schedule == roundrobin && !quantumset)
+    options->run.quantum = DEFAULTQUANTUM;
+  if (options->run.schedule == roundrobin && !options->run.quantum) {
+    fprintf(stderr,"--schedule=roundrobin needs a quantum\n");
+    display_usage(argv[0], -1);
+  }
+  options->configfile = argv[optind];
+  if (options->socketpath)
+    return NULL;
+  FILE *infile = fopen (options->configfile, "r");
   if (!infile) {
     perror ("failed to open configuration file");
     return NULL;
   }
 
-  if (!infile) {
-    fprintf(stderr,"Cannot open configuration file `%s'\n", argv[1]);
-    display_usage(argv[0], -1);
-  }
   // true: null-terminated string, NULL: memory allocated, 0: whole file from start
   buffer = read_file_fptr (infile, &filelength, true, NULL, 0);
   if (fclose(infile) != 0) {               // close file: return 0 == success
@@ -0,0 +1,129 @@
+/*
+ * libcachesim.c
+ *
+ * The simulator as a library: a simulator instance owns its configuration,
+ * its hierarchy (which owns the random number generators) and a lock, so
+ * nothing is shared between instances. Errors that would exit cachesim are
+ * trapped (see errortrap) and returned instead, so a bad configuration or
+ * record can't take down the program embedding the simulator.
+ *
+ */
+
+#include "libcachesim.h"
+#include "cachesetup.h"
+#include "configfile.h"
+#include "stringutils.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <setjmp.h>
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+struct Simulator {
+    CacheSetupT **parameters;
+    CacheT **cache;
+    pthread_mutex_t lock; // one call at a time on this simulator
+    bool broken;          // an error left the hierarchy part way through a reference
+}; // typedef SimulatorT
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+SimulatorT *initsimulator (const char *config) {
+    SimulatorT *simulator = malloc (sizeof (SimulatorT));
+    // linify needs a writable copy with every line ended, the last included
+    size_t length = strlen (config);
+    char *buffer = malloc (length + 2);
+    if (!simulator || !buffer) {
+        error (memoryError, true, "simulator", __LINE__, __FILE__);
+        free (simulator);
+        free (buffer);
+        return NULL;
+    }
+    // what was built of a bad configuration is not recovered
+    jmp_buf trap;
+    if (setjmp (trap)) {
+        errortrap (NULL);
+        free (simulator);
+        return NULL;
+    }
+    errortrap (&trap);
+    strcpy (buffer, config);
+    if (!length || config[length-1] != '\n')
+        strcat (buffer, "\n");
+    char **configlines = linify (buffer);
+    // either format, but only one configuration
+    ConfigsweepT *sweep = initsweep (configlines);
+    dispose_lines (configlines);
+    if (sweeppoints (sweep) != 1)
+        error (configError, false, "a simulator takes one configuration, not a sweep",
+               __LINE__, __FILE__);
+    configlines = sweepconfig (sweep, 0);
+    deconstruct_sweep (&sweep);
+    simulator->parameters = getconfig (configlines);
+    dispose_lines (configlines);
+    simulator->cache = initmultilevelcache (simulator->parameters, 0);
+    errortrap (NULL);
+    pthread_mutex_init (&simulator->lock, NULL);
+    simulator->broken = false;
+    return simulator;
+}
+
+void deconstruct_simulator (SimulatorT **simulator) {
+    deconstruct_multilevelcache ((*simulator)->cache);
+    deconstruct_setup ((*simulator)->parameters);
+    pthread_mutex_destroy (&(*simulator)->lock);
+    free (*simulator);
+    *simulator = NULL;
+}
+
+int feedsimulator (SimulatorT *simulator, const Trace records[], int Nrecords) {
+    pthread_mutex_lock (&simulator->lock);
+    int used = -1;
+    if (!simulator->broken) {
+        // writeback and victim records only follow a prefiltered L1: stop before one
+        if (!is_prefiltered (simulator->cache[0]))
+            for (int i = 0; i < Nrecords; i++)
+                if (records[i].reftype == WRITEBACK || records[i].reftype == CLEANVICTIM)
+                    Nrecords = i;
+        jmp_buf trap;
+        if (setjmp (trap)) {
+            used = -1;
+            simulator->broken = true;
+        } else {
+            errortrap (&trap);
+            used = handleRecords (simulator->cache, records, Nrecords);
+        }
+        errortrap (NULL);
+    }
+    pthread_mutex_unlock (&simulator->lock);
+    return used;
+}
+
+bool simulatorstats (SimulatorT *simulator, int level, LevelstatsT *stats) {
+    if (level < 0)
+        return false;
+    LevelstatsT all [level+1];
+    if (snapshotsimulator (simulator, all, level+1) <= level)
+        return false;
+    *stats = all[level];
+    return true;
+}
+
+int snapshotsimulator (SimulatorT *simulator, LevelstatsT stats[], int max) {
+    pthread_mutex_lock (&simulator->lock);
+    int N = getlevelstats (simulator->cache, stats, max);
+    pthread_mutex_unlock (&simulator->lock);
+    return N;
+}
+
+void reportsimulator (SimulatorT *simulator) {
+    pthread_mutex_lock (&simulator->lock);
+    reportstats (simulator->cache);
+    pthread_mutex_unlock (&simulator->lock);
+}
@@ -10,11 +10,16 @@
  */
 
 #include "multilevelAssoc.h"
+#include "victimcache.h"
+#include "tlb.h"
+#include "deltatrace.h"
+#include "rng.h"
 #include "error.h"
 #include "stringutils.h"
 
 #include <stdlib.h> // malloc
 #include <stdio.h>  // for testing
+#include <string.h> // memset
 
 /////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
 //////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
@@ -25,14 +30,77 @@ typedef unsigned Bitshift;
 // cache; from top down, cache[0] is L1I cache, cache[1] is L2D
 // if split; from there down, cache[i+1] is the next level down
 // from cache[i]
+// reference streams with an L1 each if L1 is split
+#define NSTREAMS 2
+#define STREAM(reftype) ((reftype)==FETCH?0:1)
+#define L1INDEX(cache,reftype) ((cache)[0]->split?((reftype)==FETCH?0:1):0)
+
+// a level's blocks by owner (see initmultilevelcache): matrices are indexed
+// [owner of the reference*Nowners + owner of the block]
+typedef struct {
+    ELAPSED *hits,
+            *evictions;  // blocks evicted to make room for a reference's miss
+    ELAPSED *misses;     // by owner of the reference only
+    unsigned long *blocks; // valid blocks now, counted by the ways as they change
+} OwnerstatsT;
+
+// occupancy samples kept: when full, every other one is dropped and the period
+// between them doubled, so the table is sized once
+#define MAXOCCUPANCYSAMPLES 1024
+
+// A sliced level has associativity ways for each slice, slice 0's ways first
 struct Cache {
     RawCacheT **cachedata;
+    unsigned Nslices;         // 1 unless split into slices chosen by address hash
+    Bitshift sliceshift;      // offset bits of this level's blocks, to hash on blocks
+    AllStatsT **slicestats;   // per slice, NULL if not sliced
+    unsigned slicewindow,     // requests to this level over which slices contend
+             *recentslices,   // ring buffer: slices of the last slicewindow requests
+             *slicerequests,  // how many of those went to each slice
+             nextrecent;      // where the next goes in recentslices
     LatencyT hittime,
              lookupoverhead;
     CacheAssociativityT associativity;
     bool split;
+    SetprobeT find,          // set probe kernels for this level's shape (see rawcache.h)
+              findempty;
+    InclusionT inclusion; // same at every level: whole hierarchy has one policy
     TagT assocmask;
     AllStatsT *stats;
+    VictimCacheT *victims;   // NULL if no victim cache attached to this level
+    LatencyT victimhittime;
+    AllStatsT *victimstats;
+    TLBsT *tlbs;             // translation for the whole hierarchy: cache[0] only
+    // cache[0] only: the L1 block last referenced by each stream (instructions,
+    // data), which is still in L1 as long as nothing has missed since
+    bool memo;               // false if an L1 hit is more than counts (TLBs, slices)
+    AddressT blockmask [NSTREAMS],
+             lastblock [NSTREAMS];
+    bool lastvalid [NSTREAMS];
+    // cache[0] only: L1 filtering (see getSetupFilterout)
+    FILE *filterfile;        // NULL unless simulating L1 only to make a miss stream
+    DeltaEncoderT *filter;   // its misses and blocks leaving it are written here
+    char *filtername;
+    ELAPSED filterwritebacks,
+            filtervictims;
+    bool prefiltered;        // the trace is such a stream: L1 is never filled
+    ReftypeT lastmiss;       // prefiltered: type of the miss the next victim is for
+    RandomT *random;         // this level's replacement choices
+    unsigned long seed;      // cache[0] only: the hierarchy's, each level a stream of it
+    RandomT *tlbrandom;      // cache[0] only: the TLBs' replacement choices, the last stream
+    ArenaT *arena;           // cache[0] only: the whole hierarchy is allocated from it
+    OwnerstatsT *owners;     // NULL unless attributing blocks to owners
+    // cache[0] only: attribution (see initmultilevelcache and sampleowners)
+    unsigned Nowners,        // 0 unless attributing
+             owner;          // of the references being simulated
+    TagT ownerbits;          // owner as tag bits, to put in blocks filled
+    unsigned long occupancyperiod, // references between samples: 0 for none
+                  occupancyasked,  // the period as set, before samples were thinned
+                  sincesample,     // references since the last sample
+                  sampled;         // references since stats were reset
+    unsigned Nsamples;             // up to MAXOCCUPANCYSAMPLES
+    unsigned long *sampledat,      // references at each sample
+                  *occupancy;      // blocks [sample][level][owner]
 };  //typedef CacheT
 
 struct AllStats {
@@ -41,14 +109,59 @@ struct AllStats {
           *replacecount,
           *inclusioncount,
           *hitcost,
-          *misscost;
+          *misscost,
+          *queuecost;  // waiting for a busy slice
 };
 
 
 //////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
 
+// handleReference for an access within one L1 block
+static void blockReference (CacheT* thecache[], AddressT where, ReftypeT reftype);
+
+// as findInCache but also reports whether the block was found in the victim
+// cache of the level returned rather than the level itself
+static int findInHierarchy (CacheT* thecache[], AddressT where, ReftypeT reftype,
+                            bool *invictims);
+
 // deal with a cache miss: place at all levels to maintain inclusion
-static void handleMiss (CacheT* thecache[], AddressT where, ReftypeT reftype, int foundat);
+static void handleMiss (CacheT* thecache[], AddressT where, ReftypeT reftype, int foundat,
+                        bool invictims);
+
+// free up a way for the given address in one level, evicting if necessary
+static CacheAssociativityT makeroom (CacheT* thecache[], int level, AddressT where,
+                                     ReftypeT reftype);
+
+// as handleMiss for an exclusive hierarchy: move the block up to L1 only
+static void handleExclusiveMiss (CacheT* thecache[], AddressT where, ReftypeT reftype,
+                                 int foundat, bool invictims);
+
+// place a block in a level of an exclusive hierarchy, passing any victim down
+static void exclusiveFill (CacheT* thecache[], int level, AddressT where, TagT tags,
+                           ReftypeT reftype);
+
+// a block leaving a level of an exclusive hierarchy: move it down a level
+static void exclusiveDemote (CacheT* thecache[], int level, AddressT where, TagT tags,
+                             ReftypeT reftype);
+
+// the ways of the slice an address falls in (all ways if not sliced)
+static RawCacheT **waysfor (CacheT *cache, AddressT where);
+
+// as assocCacheHit for a lookup that is a request to the level, so counts
+// towards per-slice stats and contention
+static CacheAssociativityT probe (CacheT *cache, AddressT where, ReftypeT reftype);
+
+// look up a physical address, returning roughly the time it took: the L1 hit time
+// plus on a miss the hit time of where it was found
+static LatencyT physicalReference (CacheT* thecache[], AddressT where, ReftypeT reftype);
+
+// translate a virtual address through the TLBs, walking the page table through
+// the data caches on a TLB miss
+static AddressT translate (CacheT* thecache[], AddressT where, ReftypeT reftype);
+
+// add 1 to the count or cost for the type of reference
+static void incrcount (StatsT *stats, ReftypeT reftype);
+static void incrcost (StatsT *stats, ReftypeT reftype, ELAPSED cost);
 
 static AddressT getAddressMask (BlocksizeT blocksize);
 
@@ -60,11 +173,50 @@ static Bitshift calculateIndexBits (CachesizeT Nblocks);
 
 static Bitshift calculateOffsetBits (BlocksizeT blocksize);
 
-static AllStatsT* init_all_stats ();
-static void deconstruct_all_stats (AllStatsT* stats);
+static AllStatsT* init_all_stats (ArenaT *arena);
+static size_t allstatsbytes ();
+static void reset_all_stats (AllStatsT *allstats);
+
+// report a level's (or victim cache's or slice's) stats by type and in total;
+// in an exclusive hierarchy inclusions are victim fills
+static void report_all_stats (ReportT *report, const char *unit, AllStatsT *allstats,
+                              bool exclusivefills);
+
+// forget which slices recent requests went to, as when new
+static void resetslicewindow (CacheT *level);
+
+// fill in a level from its parameters, allocating what it needs from arena
+static void initAssocCache (CacheT *assoccache, CacheSetupT *cacheinfo, ArenaT *arena);
+
+// space initAssocCache allocates from the arena for a level, and the owner
+// stats initmultilevelcache gives it if attributing to Nowners
+static size_t levelbytes (CacheSetupT *cacheinfo, unsigned Nowners);
+
+// owner stats for a level, allocated from arena
+static OwnerstatsT *initownerstats (unsigned Nowners, ArenaT *arena);
 
 static void dowrite (CacheT *level, AddressT where);
-static void maintaininclusion (CacheT* multilevelcache [], int misslevel, AddressT where,
+
+// write a block leaving L1 to the L1 miss stream
+static void filtervictim (CacheT* thecache[], AddressT where, TagT tags);
+
+// tell whether results from an L1 miss stream match simulating L1 as well
+static void reportfilter (CacheT* thecache[]);
+
+// count a hit on a block of a level found in a way, by owner
+static void ownerhit (CacheT* thecache[], CacheT *level, AddressT where,
+                      CacheAssociativityT way);
+
+// count references towards occupancy samples, taking any that fall due
+static void sampleoccupancy (CacheT* thecache[], unsigned long references);
+
+// name of cache[i] as reported: L1, L1I, L2...
+static void levelname (CacheT* thecache[], int i, char *name, size_t size);
+
+// attribution by owner as text, and for a report
+static void reportowners (CacheT* thecache[]);
+static void reportownersto (CacheT* thecache[], ReportT *report);
+static bool maintaininclusion (CacheT* multilevelcache [], int misslevel, AddressT where,
                                ReftypeT reftype);
 
 
@@ -91,38 +243,97 @@ bool is_split (CacheT *cache) {
         return false;
 }
 
-static CacheT * initAssocCache (CacheSetupT *cacheinfo) {
+bool is_prefiltered (CacheT *cache) {
+    return cache && cache->prefiltered;
+}
+
+static void initAssocCache (CacheT *assoccache, CacheSetupT *cacheinfo, ArenaT *arena) {
     CacheAssociativityT associativity = getSetupAssociativity (cacheinfo);
-    if (associativity && !checkPowerof2(associativity))
-        error (badAssociativity, true, "Cache associativity should be a power of 2",
-               __LINE__, __FILE__);
+    IndexfunctionT indexfunction = getSetupIndexfunction (cacheinfo);
     CachesizeT totalblocks = getSetupTotalblocks (cacheinfo);
     BlocksizeT blocksize = getSetupBlocksize (cacheinfo);
     LatencyT hittime = getSetupHittime (cacheinfo);
     LatencyT lookupoverhead = getSetupLookupoverhead (cacheinfo);
     bool split = getSetupSplit (cacheinfo);
-    if (associativity && totalblocks % associativity)
+    unsigned Nslices = getSetupSlices (cacheinfo);
+    if (associativity && totalblocks % (associativity*Nslices))
         error (badAssociativity, false, "Associativity cache blocks don't divide evenly between ways",
                __LINE__, __FILE__);
 
-    CacheT * assoccache = malloc(sizeof(CacheT));
+    assoccache->tlbs = NULL;
+    assoccache->owners = NULL;
+    assoccache->Nslices = Nslices;
+    assoccache->slicestats = NULL;
+    assoccache->recentslices = assoccache->slicerequests = NULL;
     if (associativity) {
-        assoccache->cachedata = malloc(sizeof(RawCacheT*)*associativity);
-        for (int i = 0; i < associativity; i++) {
+        assoccache->cachedata = arenaalloc (arena, sizeof(RawCacheT*)*associativity*Nslices);
+        for (int i = 0; i < associativity*Nslices; i++) {
             assoccache->cachedata[i] = 
-            initrawcache (totalblocks/associativity,
-                          blocksize);
+            initrawcacheindexed (totalblocks/(associativity*Nslices),
+                                 blocksize, indexfunction, i % associativity, arena);
          }
+         setprobesfor (assoccache->cachedata, associativity,
+                       &assoccache->find, &assoccache->findempty);
          assoccache->assocmask = getMask (associativity);
+         assoccache->sliceshift = calculateOffsetBits (blocksize);
     } else {
         assoccache->cachedata = NULL; // should only happen with main memory
     }
+    if (associativity && Nslices > 1) {
+        assoccache->slicestats = arenaalloc (arena, sizeof(AllStatsT*)*Nslices);
+        for (int i = 0; i < Nslices; i++)
+            assoccache->slicestats[i] = init_all_stats (arena);
+        assoccache->slicewindow = getSetupSlicewindow (cacheinfo);
+        assoccache->recentslices = arenaalloc (arena, sizeof(unsigned)*assoccache->slicewindow);
+        assoccache->slicerequests = arenaalloc (arena, sizeof(unsigned)*Nslices);
+        resetslicewindow (assoccache);
+    }
     assoccache->hittime = hittime;
     assoccache->lookupoverhead = lookupoverhead;
     assoccache->associativity = associativity;
     assoccache->split = split;
-    assoccache->stats = init_all_stats ();
-    return assoccache;
+    assoccache->stats = init_all_stats (arena);
+    if (getSetupVictimblocks (cacheinfo)) {
+        assoccache->victims = initvictimcache (getSetupVictimblocks (cacheinfo), blocksize,
+                                               arena);
+        assoccache->victimhittime = getSetupVictimhittime (cacheinfo);
+        assoccache->victimstats = init_all_stats (arena);
+    } else {
+        assoccache->victims = NULL;
+        assoccache->victimhittime = 0;
+        assoccache->victimstats = NULL;
+    }
+}
+
+static size_t levelbytes (CacheSetupT *cacheinfo, unsigned Nowners) {
+    CacheAssociativityT associativity = getSetupAssociativity (cacheinfo);
+    unsigned Nslices = getSetupSlices (cacheinfo);
+    size_t bytes = allstatsbytes ();
+    if (associativity && Nowners)
+        bytes += arenabytes (sizeof (OwnerstatsT)) +
+                 2*arenabytes (sizeof (ELAPSED)*Nowners*Nowners) +
+                 arenabytes (sizeof (ELAPSED)*Nowners) +
+                 arenabytes (sizeof (unsigned long)*Nowners);
+    if (associativity)
+        bytes += arenabytes (sizeof(RawCacheT*)*associativity*Nslices) +
+                 associativity*Nslices*
+                 rawcachebytes (getSetupTotalblocks (cacheinfo)/(associativity*Nslices));
+    if (associativity && Nslices > 1)
+        bytes += arenabytes (sizeof(AllStatsT*)*Nslices) + Nslices*allstatsbytes () +
+                 arenabytes (sizeof(unsigned)*getSetupSlicewindow (cacheinfo)) +
+                 arenabytes (sizeof(unsigned)*Nslices);
+    if (getSetupVictimblocks (cacheinfo))
+        bytes += victimcachebytes (getSetupVictimblocks (cacheinfo)) + allstatsbytes ();
+    return bytes;
+}
+
+static OwnerstatsT *initownerstats (unsigned Nowners, ArenaT *arena) {
+    OwnerstatsT *owners = arenaalloc (arena, sizeof (OwnerstatsT));
+    owners->hits = arenaalloc (arena, sizeof (ELAPSED)*Nowners*Nowners);
+    owners->evictions = arenaalloc (arena, sizeof (ELAPSED)*Nowners*Nowners);
+    owners->misses = arenaalloc (arena, sizeof (ELAPSED)*Nowners);
+    owners->blocks = arenaalloc (arena, sizeof (unsigned long)*Nowners);
+    return owners;
 }
 
 // set up mutliple cache levels; top level can be split
@@ -133,36 +344,182 @@ static CacheT * initAssocCache (CacheSetupT *cacheinfo) {
 // for split L1, newcaches[0] and newcaches[1] constitute L1;
 // for unified L1, L2 starts at newcaches[1]
     
-CacheT** initmultilevelcache (CacheSetupT * caches []) {
+// When filtering, only L1 and DRAM are set up.
+// Everything is in one arena: the array of levels, then the levels themselves
+// next to each other, then what each level points to in turn, then the
+// occupancy samples if attributing.
+CacheT** initmultilevelcache (CacheSetupT * caches [], unsigned Nowners) {
     // int startL2 = 1; // where to start L2
     int Ncaches = 0;
     checkparameters (caches);
     // count how many cache data structures needed: end on NULL entry
     for (Ncaches = 0; caches[Ncaches]; Ncaches++) ;
-    CacheT** newcaches = malloc (sizeof(CacheT*)*(Ncaches+1));
+    char *filtername = getSetupFilterout (caches[0]);
+    int L1s = getSetupSplit (caches[0])?2:1,
+        Nused = filtername?L1s+1:Ncaches, // L1 and DRAM if filtering
+        Nsampled = 0;                     // levels with owner stats
+    if (Nowners > MAXOWNERS)
+        error (workloadError, false, "too many owners to attribute blocks to",
+               __LINE__, __FILE__);
+    size_t bytes = arenabytes (sizeof(CacheT*)*(Nused+1)) + arenabytes (sizeof(CacheT)*Nused) +
+                   (Nused+1)*randombytes () + tlbsbytes (caches[0]);
+    for (int i = 0; i < Nused; i++) {
+        CacheSetupT *setup = i < L1s || !filtername ? caches[i] : caches[Ncaches-1];
+        bytes += levelbytes (setup, Nowners);
+        if (getSetupAssociativity (setup))
+            Nsampled++;
+    }
+    if (Nowners)
+        bytes += arenabytes (sizeof (unsigned long)*MAXOCCUPANCYSAMPLES) +
+                 arenabytes (sizeof (unsigned long)*MAXOCCUPANCYSAMPLES*Nsampled*Nowners);
+    ArenaT *arena = initarena (bytes);
+    CacheT** newcaches = arenaalloc (arena, sizeof(CacheT*)*(Nused+1));
+    CacheT *levels = arenaalloc (arena, sizeof(CacheT)*Nused);
     // for split L1, newcaches[0] and newcaches[1] constitute L1;
     // for unified L1, L2 starts at newcaches[1]
-    for (int i = 0; caches[i]; i++) {
-        newcaches[i] = initAssocCache (caches[i]);
+    for (int i = 0; i < Nused; i++) {
+        CacheSetupT *setup = i < L1s || !filtername ? caches[i] : caches[Ncaches-1];
+        newcaches[i] = &levels[i];
+        initAssocCache (newcaches[i], setup, arena);
+        newcaches[i]->inclusion = getSetupInclusion (caches[0]);
+        if (Nowners && newcaches[i]->associativity) {
+            newcaches[i]->owners = initownerstats (Nowners, arena);
+            for (int way = 0; way < newcaches[i]->associativity*newcaches[i]->Nslices; way++)
+                setownercounts (newcaches[i]->cachedata[way], newcaches[i]->owners->blocks);
+        }
+    }
+    newcaches[0]->arena = arena;
+    // each level draws from its own stream of the seed, so a level's choices
+    // are the same whatever the levels around it do (and L1's the same when
+    // filtering and when simulating the full hierarchy)
+    newcaches[0]->seed = getSetupSeed (caches[0]);
+    for (int i = 0; i < Nused; i++)
+        newcaches[i]->random = initrandom (newcaches[0]->seed, i, arena);
+    newcaches[0]->tlbrandom = initrandom (newcaches[0]->seed, Nused, arena);
+    newcaches[0]->tlbs = inittlbs (caches[0], newcaches[0]->tlbrandom, arena);
+    newcaches[Nused] = NULL; // mark the end
+    newcaches[0]->filterfile = NULL;
+    newcaches[0]->filter = NULL;
+    newcaches[0]->filtername = filtername;
+    if (filtername) {
+        newcaches[0]->filterfile = fopen (filtername, "wb");
+        if (!newcaches[0]->filterfile)
+            error (traceError, false, filtername, __LINE__, __FILE__);
+        newcaches[0]->filter = initdeltaencoder (newcaches[0]->filterfile);
+    }
+    newcaches[0]->filterwritebacks = newcaches[0]->filtervictims = 0;
+    newcaches[0]->prefiltered = getSetupPrefiltered (caches[0]);
+    newcaches[0]->lastmiss = FETCH;
+    newcaches[0]->Nowners = Nowners;
+    newcaches[0]->owner = newcaches[0]->ownerbits = 0;
+    newcaches[0]->occupancyperiod = newcaches[0]->occupancyasked = 0;
+    newcaches[0]->sincesample = newcaches[0]->sampled = 0;
+    newcaches[0]->Nsamples = 0;
+    newcaches[0]->sampledat = newcaches[0]->occupancy = NULL;
+    if (Nowners) {
+        newcaches[0]->sampledat = arenaalloc (arena, sizeof (unsigned long)*MAXOCCUPANCYSAMPLES);
+        newcaches[0]->occupancy = arenaalloc (arena, sizeof (unsigned long)*
+                                              MAXOCCUPANCYSAMPLES*Nsampled*Nowners);
+    }
+    // a prefiltered L1 holds nothing, so nothing to remember; every L1 hit needs
+    // its block's owner if attributing, so none can only be counted
+    newcaches[0]->memo = !newcaches[0]->tlbs && !newcaches[0]->prefiltered && !Nowners;
+    for (int stream = 0; stream < NSTREAMS; stream++) {
+        CacheT *L1 = newcaches[L1INDEX(newcaches, stream ? READ : FETCH)];
+        if (L1->Nslices > 1)
+            newcaches[0]->memo = false;
+        newcaches[0]->blockmask[stream] = ~(getblocksize (L1->cachedata[0]) - 1);
+        newcaches[0]->lastvalid[stream] = false;
     }
-    newcaches[Ncaches] = NULL; // mark the end
     return newcaches;
 }
 
+// Tags, TLB entries and page table are zero when empty, so big ones are
+// dropped by the arena rather than written over
+void flushmultilevelcache (CacheT *cache[]) {
+    for (int i = 0; cache[i]; i++) {
+        for (int way = 0; cache[i]->cachedata && way < cache[i]->associativity*cache[i]->Nslices;
+             way++)
+            flushrawcache (cache[i]->cachedata[way]);
+        if (cache[i]->victims)
+            flushvictimcache (cache[i]->victims);
+        if (cache[i]->recentslices)
+            resetslicewindow (cache[i]);
+        if (cache[i]->owners)
+            memset (cache[i]->owners->blocks, 0, sizeof (unsigned long)*cache[0]->Nowners);
+    }
+    if (cache[0]->tlbs)
+        flushtlbs (cache[0]->tlbs);
+    for (int stream = 0; stream < NSTREAMS; stream++)
+        cache[0]->lastvalid[stream] = false; // no longer in L1
+    cache[0]->lastmiss = FETCH;
+}
+
+// no memo to clear: there is none with TLBs
+void contextswitch (CacheT *cache[]) {
+    if (cache[0]->tlbs)
+        flushtlbentries (cache[0]->tlbs);
+}
+
+void sampleowners (CacheT *cache[], unsigned long period) {
+    if (!cache[0]->Nowners)
+        error (workloadError, false, "occupancy sampled without attributing blocks",
+               __LINE__, __FILE__);
+    cache[0]->occupancyperiod = cache[0]->occupancyasked = period;
+}
+
+void setowner (CacheT *cache[], unsigned owner) {
+    if (owner >= cache[0]->Nowners)
+        error (workloadError, false, "owner out of range", __LINE__, __FILE__);
+    cache[0]->owner = owner;
+    cache[0]->ownerbits = owner << OWNERSHIFT;
+}
+
+void resetmultilevelstats (CacheT *cache[]) {
+    for (int i = 0; cache[i]; i++) {
+        reset_all_stats (cache[i]->stats);
+        for (int slice = 0; cache[i]->slicestats && slice < cache[i]->Nslices; slice++)
+            reset_all_stats (cache[i]->slicestats[slice]);
+        if (cache[i]->victimstats)
+            reset_all_stats (cache[i]->victimstats);
+    }
+    if (cache[0]->tlbs)
+        resettlbstats (cache[0]->tlbs);
+    cache[0]->filterwritebacks = cache[0]->filtervictims = 0;
+    unsigned N = cache[0]->Nowners;
+    for (int i = 0; N && cache[i]; i++)
+        if (cache[i]->owners) {
+            memset (cache[i]->owners->hits, 0, sizeof (ELAPSED)*N*N);
+            memset (cache[i]->owners->evictions, 0, sizeof (ELAPSED)*N*N);
+            memset (cache[i]->owners->misses, 0, sizeof (ELAPSED)*N);
+        }
+    cache[0]->Nsamples = 0;
+    cache[0]->sincesample = cache[0]->sampled = 0;
+    cache[0]->occupancyperiod = cache[0]->occupancyasked;
+}
+
+void resetmultilevelcache (CacheT *cache[]) {
+    flushmultilevelcache (cache);
+    resetmultilevelstats (cache);
+    int Nlevels;
+    for (Nlevels = 0; cache[Nlevels]; Nlevels++)
+        reseedrandom (cache[Nlevels]->random, cache[0]->seed, Nlevels);
+    reseedrandom (cache[0]->tlbrandom, cache[0]->seed, Nlevels);
+}
+
 void deconstruct_multilevelcache (CacheT** caches) {
-    for (int Ncaches = 0; caches[Ncaches]; Ncaches++) {
-        deconstruct_all_stats (caches[Ncaches]->stats);
-        free(caches[Ncaches]);
+    if (caches[0]->filter) {
+        finishdeltaencoder (&caches[0]->filter);
+        if (fclose (caches[0]->filterfile))
+            error (traceError, false, caches[0]->filtername, __LINE__, __FILE__);
     }
-    free (caches);
+    ArenaT *arena = caches[0]->arena; // in the arena, so copy before freeing it
+    deconstruct_arena (&arena);
 }
 
+// every way at once, with the kernel picked for this level's shape
 CacheAssociativityT assocCacheHit (CacheT* thecache, AddressT where) {
-    for (int i = 0; i < thecache->associativity; i++) {
-        if (rawCacheHit (thecache->cachedata[i], where))
-            return i;
-    }
-    return thecache->associativity; // miss
+    return thecache->find (waysfor (thecache, where), thecache->associativity, where);
 }
 
 // pass in a pointer to the cache array at the level of interest
@@ -180,9 +537,9 @@ bool cacheHit (CacheT* thecache[], AddressT where, ReftypeT reftype) {
     return false;
 }
 
+#ifdef DEBUG
 static int maxfoundat = 0;
 static int maxI = 0;
-#ifdef DEBUG
 static LatencyT maxhitcost = 0;
 #endif
 
@@ -193,6 +550,16 @@ static LatencyT maxhitcost = 0;
 // if not in any level, no cost to check if in main memory since we are not modelling VM so
 // everything is assumed to be in DRAM; only DRAM cost is copying to LLC
 int findInCache (CacheT* thecache[], AddressT where, ReftypeT reftype) {
+    bool invictims;
+    return findInHierarchy (thecache, where, reftype, &invictims);
+}
+
+// A level's victim cache is checked when the level itself misses and counts as part
+// of the level: if found there, the victim cache's hit time is the cost instead of
+// the level's. This includes L1, where a victim cache hit is not an L1 hit as it
+// needs a swap.
+static int findInHierarchy (CacheT* thecache[], AddressT where, ReftypeT reftype,
+                            bool *invictims) {
     int startL2 = 1;
     int offEdge = countlevels (thecache); // 1 more than highest index in cache array
     int foundat = offEdge;
@@ -205,15 +572,35 @@ int findInCache (CacheT* thecache[], AddressT where, ReftypeT reftype) {
         foundat++;
         L1Dindex = 1;
     }
+    *invictims = false;
     // first check if in L1; no cost for this here, accounted for in handleReference
     if (reftype == FETCH) {
-        if (assocCacheHit (thecache[L1Iindex], where) < thecache[L1Iindex]->associativity)
+        CacheAssociativityT way = probe (thecache[L1Iindex], where, reftype);
+        if (way < thecache[L1Iindex]->associativity) {
+           if (thecache[L1Iindex]->owners)
+               ownerhit (thecache, thecache[L1Iindex], where, way);
            return L1Iindex;
+        }
     } else {  // if not a fetch, need to correct lookupcost
-        if (assocCacheHit (thecache[L1Dindex], where) < thecache[L1Dindex]->associativity)
+        CacheAssociativityT way = probe (thecache[L1Dindex], where, reftype);
+        if (way < thecache[L1Dindex]->associativity) {
+           if (thecache[L1Dindex]->owners)
+               ownerhit (thecache, thecache[L1Dindex], where, way);
            return L1Dindex;
+        }
         lookupcost = thecache[L1Dindex]->lookupoverhead; // need this now
     }
+    int indexL1 = (reftype == FETCH)?L1Iindex:L1Dindex;
+    if (thecache[indexL1]->victims) {
+        if (victimHit (thecache[indexL1]->victims, where)) {
+            incrcost (thecache[L1Dindex]->stats->misscost, reftype,
+                      thecache[indexL1]->victimhittime);
+            incrcount (thecache[indexL1]->victimstats->hitcount, reftype);
+            *invictims = true;
+            return indexL1;
+        }
+        incrcount (thecache[indexL1]->victimstats->misscount, reftype);
+    }
 #ifdef DEBUG
     fprintf(stderr, "Not found in L1: 0x%x [%c]", where, reftype);
 #endif
@@ -222,10 +609,15 @@ int findInCache (CacheT* thecache[], AddressT where, ReftypeT reftype) {
     for (int i = startL2; i < offEdge; i++) {
         // inclur the lookup overhead at each level: in a real cache done in parallel
         // so only score the max value
+#ifdef DEBUG
         if (i > maxI) maxI = i;
+#endif
         if (thecache[i]->lookupoverhead > lookupcost)
             lookupcost = thecache[i]->lookupoverhead;
-        if (assocCacheHit (thecache[i], where) < thecache[i]->associativity) {
+        CacheAssociativityT way = probe (thecache[i], where, reftype);
+        if (way < thecache[i]->associativity) {
+            if (thecache[i]->owners)
+                ownerhit (thecache, thecache[i], where, way);
             AllStatsT * stats = thecache[i]->stats;
             LatencyT hitcost = thecache[i]->hittime;
 #ifdef DEBUG
@@ -234,8 +626,21 @@ int findInCache (CacheT* thecache[], AddressT where, ReftypeT reftype) {
            foundat = i;
            break;
         }
+        if (thecache[i]->victims) {
+            if (victimHit (thecache[i]->victims, where)) {
+               foundat = i;
+               *invictims = true;
+               break;
+            }
+            incrcount (thecache[i]->victimstats->misscount, reftype);
+        }
     }
     LatencyT hitcost = thecache[foundat]->hittime;
+    if (*invictims) { // costs and counts belong to the victim cache, not the level
+        incrcost (thecache[L1Dindex]->stats->misscost, reftype, thecache[foundat]->victimhittime);
+        incrcount (thecache[foundat]->victimstats->hitcount, reftype);
+        return foundat;
+    }
     if (reftype == FETCH) {
         incrIcost (thecache[L1Dindex]->stats->misscost, hitcost);
         if (foundat < offEdge) {
@@ -266,15 +671,11 @@ int findInCache (CacheT* thecache[], AddressT where, ReftypeT reftype) {
     return foundat;
 }
 
-#define L1INDEX(cache,reftype) (cache[0]->split?(reftype==FETCH?0:1):0)
-
-static ELAPSED refcount = 0;
-
 // check the cacche has no 0 address tag with VALID set on
 static bool cachecheck (CacheT* thecache[]) {
    for (int i = 0; thecache[i]; i++) {
       CacheT * cache = thecache [i];
-      for (int j = 0; j < cache->associativity; j++) {
+      for (int j = 0; j < cache->associativity*cache->Nslices; j++) {
          if (!rawcachecheck (cache->cachedata[j]))
            return false;
       }
@@ -282,17 +683,130 @@ static bool cachecheck (CacheT* thecache[]) {
    return true;
 }
 
-void handleReference (CacheT* thecache[], AddressT where, ReftypeT reftype) {
+// An access straddling L1 blocks is a reference to each block it touches, in
+// order, so a lower level sees one for each L1 block it has to supply: with
+// bigger blocks there, the second is a hit.
+void handleReference (CacheT* thecache[], AddressT where, ReftypeT reftype,
+                      unsigned size) {
+    blockReference (thecache, where, reftype);
+    if (size <= 1)
+        return;
+    // usually all in one block, so nothing more to do
+    AddressT blockmask = thecache[0]->blockmask[STREAM(reftype)],
+             lastblock = (where + size - 1) & blockmask;
+    for (AddressT block = where & blockmask; block != lastblock; ) {
+        block += ~blockmask + 1;
+        blockReference (thecache, block, reftype);
+    }
+}
+
+// After the first fetch of a run in an L1 block, the rest in the same block
+// are certain to hit: the block has just been put in L1 if it wasn't there, and
+// nothing can evict it in between. So they only need counting, unless there is
+// more to a hit than L1's counts and hit time (a TLB lookup or slice contention),
+// L1 is prefiltered or the fetches have a size, so may straddle blocks.
+void handleRun (CacheT* thecache[], AddressT where, ReftypeT reftype,
+                unsigned count, int stride, unsigned size) {
+    CacheT *L1 = thecache[L1INDEX(thecache,reftype)];
+    bool countonly = reftype == FETCH && thecache[0]->memo && size <= 1;
+    BlocksizeT blocksize = getblocksize (L1->cachedata[0]);
+    while (count) {
+        handleReference (thecache, where, reftype, size);
+        count--;
+        if (!countonly) {
+            where += stride;
+            continue;
+        }
+        // how many more of the run fall in the same block
+        AddressT offset = where & (blocksize - 1);
+        unsigned sameblock = count;
+        if (stride > 0 && (blocksize - 1 - offset) / stride < count)
+            sameblock = (blocksize - 1 - offset) / stride;
+        else if (stride < 0 && offset / -stride < count)
+            sameblock = offset / -stride;
+        if (sameblock) {
+            addIcount (L1->stats->hitcount, sameblock);
+            incrIcost (L1->stats->hitcost, (ELAPSED) sameblock * L1->hittime);
+            count -= sameblock;
+        }
+        where += (sameblock + 1) * stride;
+    }
+}
+
+// Replays what happened when the block left L1 in the run that made the miss
+// stream (see makeroom and exclusiveFill), for the miss just handled
+void handleVictim (CacheT* thecache[], AddressT where, bool modified) {
+    CacheT *first = thecache[0];
+    if (!first->prefiltered)
+        error (traceError, false,
+               "writeback or victim record: L1 not prefiltered", __LINE__, __FILE__);
+    ReftypeT reftype = first->lastmiss;
+    int level = L1INDEX(thecache,reftype);
+    incrcount (thecache[level]->stats->replacecount, reftype);
+    if (first->inclusion == exclusive)
+        exclusiveDemote (thecache, level, where, modified?MODIFIED:0, reftype);
+    else if (modified)
+        dowrite (thecache[level+1], where);
+}
+
+int handleRecords (CacheT* thecache[], const Trace records[], int Nrecords) {
+    for (int i = 0; i < Nrecords; i++) {
+        Trace record = records[i];
+        if (record.reftype == EXCEPTION)
+            continue; // skip these
+        if (record.reftype == WRITEBACK || record.reftype == CLEANVICTIM) {
+            for (unsigned j = 0; j < record.count; j++)
+                handleVictim (thecache, record.addr + j*record.stride,
+                              record.reftype == WRITEBACK);
+            continue;
+        }
+        if (record.reftype != READ && record.reftype != WRITE && record.reftype != FETCH)
+            return i; // end of trace
+        if (record.count > 1)
+            handleRun (thecache, record.addr, record.reftype, record.count, record.stride,
+                       record.size);
+        else
+            handleReference (thecache, record.addr, record.reftype, record.size);
+        if (thecache[0]->occupancyperiod)
+            sampleoccupancy (thecache, record.count);
+    }
+    return Nrecords;
+}
+
+// with TLBs, addresses in the trace are virtual
+// A reference to the same L1 block as the last of its stream is a certain hit:
+// only random replacement, so a hit changes nothing but the stats
+static void blockReference (CacheT* thecache[], AddressT where, ReftypeT reftype) {
+    CacheT *first = thecache[0];
+    int stream = STREAM(reftype);
+    if (first->lastvalid[stream] &&
+        (where & first->blockmask[stream]) == first->lastblock[stream]) {
+        CacheT *L1 = thecache[L1INDEX(thecache,reftype)];
+        incrcount (L1->stats->hitcount, reftype);
+        incrcost (L1->stats->hitcost, reftype, L1->hittime);
+        return;
+    }
+    if (first->tlbs)
+        where = translate (thecache, where, reftype);
+    physicalReference (thecache, where, reftype);
+    // a miss cleared the memo as it may have removed blocks from L1
+    if (first->memo) {
+        first->lastblock[stream] = where & first->blockmask[stream];
+        first->lastvalid[stream] = true;
+    }
+}
+
+static LatencyT physicalReference (CacheT* thecache[], AddressT where, ReftypeT reftype) {
     int startL2 = thecache[0]->split?2:1; // use to differentiat split and unified L1
     // if L1 split, L1I at cache[0] for fetch and L1D at cache[1], unified L1 at cache[0]
-    int foundat = findInCache (thecache, where, reftype), // 0 or 1 if no miss
+    bool invictims;
+    int foundat = findInHierarchy (thecache, where, reftype, &invictims), // 0 or 1 if no miss
         indexL1 = L1INDEX(thecache,reftype);
     // add L1 costs here: elsewhere add costs there
     // in L1, no miss costs to account for
     ELAPSED lookupcost = thecache[indexL1]->lookupoverhead,
             hittime = thecache[indexL1]->hittime;
-refcount++;
-    if (foundat == indexL1) {
+    if (foundat == indexL1 && !invictims) {
 #ifdef DEBUG
         fprintf(stderr,"hit 0x%x, hitcost = %lu\n", where, hittime);
 #endif
@@ -316,81 +830,97 @@ refcount++;
          } else if (reftype == WRITE) {
             incrDWcost (thecache[indexL1]->stats->misscost, hittime);
          }
-         handleMiss (thecache, where, reftype, foundat);
+         handleMiss (thecache, where, reftype, foundat, invictims);
+         return hittime + (invictims?thecache[foundat]->victimhittime:misscost);
     }
+    return hittime;
+}
+
+static AddressT translate (CacheT* thecache[], AddressT where, ReftypeT reftype) {
+    TLBsT *tlbs = thecache[0]->tlbs;
+    AddressT physical, ptes[MAXWALK];
+    if (tlbLookup (tlbs, where, reftype, &physical))
+        return physical;
+    int steps = tlbWalk (tlbs, where, ptes);
+    ELAPSED walkcost = 0;
+    for (int i = 0; i < steps; i++)
+        walkcost += physicalReference (thecache, ptes[i], READ);
+    return tlbFill (tlbs, where, reftype, walkcost);
 }
 
-static void handleMiss (CacheT* thecache[], AddressT where, ReftypeT reftype, int foundat) {
+static void handleMiss (CacheT* thecache[], AddressT where, ReftypeT reftype, int foundat,
+                        bool invictims) {
     bool split = thecache[0]->split;
     int startL2 = split?2:1; // use to differentiat split and unified L1
     int offEdge = countlevels (thecache); // 1 more than highest index in cache array
     int indexL1D = startL2-1;
 
+    // any block in L1 may be replaced or invalidated from here on
+    for (int stream = 0; stream < NSTREAMS; stream++)
+        thecache[0]->lastvalid[stream] = false;
+    if (thecache[0]->filter)
+        deltaencode (thecache[0]->filter, (Trace) {reftype, where, 1, 0});
+    thecache[0]->lastmiss = reftype;
+    if (thecache[0]->inclusion == exclusive) {
+        handleExclusiveMiss (thecache, where, reftype, foundat, invictims);
+        return;
+    }
     if (split) {
         offEdge++;
     }
+    // found in a victim cache: swap it back into its level, whose victim takes
+    // its place in the victim cache
+    if (invictims) {
+        TagT tags;
+        victimTake (thecache[foundat]->victims, where, &tags);
+        RawCacheT *rawcache = waysfor (thecache[foundat], where)[makeroom (thecache, foundat,
+                                                                           where, reftype)];
+        insert (rawcache, where);
+        if ((tags & MODIFIED) || reftype == WRITE)
+            setbits (rawcache, blockaddress (rawcache, where), MODIFIED);
+        if (thecache[0]->ownerbits)
+            setbits (rawcache, blockaddress (rawcache, where), thecache[0]->ownerbits);
+    }
     // place at each cache level above where it was found to maintain inclusion
     // any replacements also have to be done so as to maintain inclusion; doing
     // this from lowest level up increases the chances that we do not need to
     // replace again as we move up, as lower-level replacements should open up
     // a spot higher up (not always: if the higher level cache is less associative
     // the lower-level eviction may not necessarily map to the same block). If foundat
-    // is 1 off the edge, we get a miss from LLC.
+    // is 1 off the edge, we get a miss from LLC. A non-inclusive hierarchy fills
+    // the same way but does not back-invalidate upper levels on a replacement.
     for (int level = foundat-1; level >= indexL1D; level--) {
         int i = level;
         if (split && (reftype == FETCH) && (i == indexL1D))
             i--;  // i == 1 for L1, fetch handled differently for split cache
-        CacheAssociativityT associativity = thecache[i]->associativity;
-        CacheAssociativityT candidate = assocFindEmpty (thecache[i], where);
 //printf("placing 0x%x in $[%d]\n", where, level);
 #ifdef DEBUG
         fprintf(stderr,"placing 0x%x in $[%d] ", where, level);
 #endif
-        if (candidate >= associativity) { // none invalid, choose a victim
-            candidate = assocFindVictim (thecache[i]);
-            // We need an address that takes us to the block we are evicting:
-            // reverse calculation we did to put in the address tag to maintain inclusion
-            // since other levels may have a different block size
+        // a prefiltered L1 only counts the miss: its victim is a separate record
+        RawCacheT *rawcache = NULL;
+        if (!thecache[0]->prefiltered || level > indexL1D) {
+            CacheAssociativityT candidate = makeroom (thecache, i, where, reftype);
 #ifdef DEBUG
-            fprintf(stderr, "replacing in way %d ", candidate);
+            fprintf (stderr, "placing in way %d\n", candidate);
 #endif
-            RawCacheT *rawcache = thecache[i]->cachedata[candidate];
-            AddressT victimwhere = tagToAddress (rawcache, blockaddress (rawcache, where));
-            if (!(status (rawcache, victimwhere) & VALID)) {
-                error (associativityError, false, "Associative cache victim should be valid",
-                       __LINE__, __FILE__);
-            }
-            maintaininclusion (thecache, i, victimwhere, reftype);
-            // no longer at any upper level, if modified higher up, modified here now
-            if (status (rawcache, where) & MODIFIED) {
-                dowrite (thecache[i+1], where); // must be at next level down
-                
-                // incur writeback penalty here; for now
-                // assume writebacks fully buffered so no write cost
-            }
-            invalidate (rawcache, where); // now free to use this block
-            if (reftype == WRITE) {
-                incrDWcount (thecache[i]->stats->replacecount);
-            } else if (reftype == READ) {
-                incrDRcount (thecache[i]->stats->replacecount);
-            } else {
-                incrIcount (thecache[i]->stats->replacecount);
-            }
+            // found empty way to put in or doing replacement into cache[candidate]
+            // account for cost of finding the place and for reading next level down
+            rawcache = waysfor (thecache[i], where)[candidate];
+            insert (rawcache, where); // make the block valid and set the address bits
+            if (thecache[0]->ownerbits)
+                setbits (rawcache, blockaddress (rawcache, where), thecache[0]->ownerbits);
         }
-#ifdef DEBUG
-        fprintf (stderr, "placing in way %d\n", candidate);
-#endif
-        // found empty way to put in or doing replacement into cache[candidate]
-        // account for cost of finding the place and for reading next level down
-        RawCacheT *rawcache = thecache[i]->cachedata[candidate];
-        insert (rawcache, where); // make the block valid and set the address bits
+        if (thecache[i]->owners)
+            thecache[i]->owners->misses[thecache[0]->owner]++;
         LatencyT lookupcost = thecache[i]->lookupoverhead,
                  misscost = thecache[i+1]->hittime + thecache[i+1]->lookupoverhead;
 #ifdef DEBUG
         fprintf(stderr, "Miss at $%d, lookup %ld miss cost %ld\n", i, lookupcost, misscost);
 #endif
         if (reftype == WRITE) {
-            setbits (rawcache, blockaddress (rawcache, where), MODIFIED);
+            if (rawcache)
+                setbits (rawcache, blockaddress (rawcache, where), MODIFIED);
             incrDWcost (thecache[i]->stats->misscost, lookupcost + misscost);
             incrDWcount (thecache[i]->stats->misscount);
         } else if (reftype == READ) {
@@ -403,16 +933,176 @@ static void handleMiss (CacheT* thecache[], AddressT where, ReftypeT reftype, in
     }
 }
 
-CacheAssociativityT assocFindEmpty (CacheT* cache, AddressT address) {
-    for (int i = 0; i < cache->associativity; i++) {
-        if (!(status (cache->cachedata[i], address) & VALID))
-          return i;
+// Find a way in the given level for a block: an empty one if possible, otherwise
+// evict a victim. A victim goes into the level's victim cache if it has one, and
+// it is the block pushed out of the victim cache, if any, that leaves the level.
+// A block leaving the level is removed from upper levels in an inclusive
+// hierarchy and if modified, written to the level below.
+static CacheAssociativityT makeroom (CacheT* thecache[], int level, AddressT where,
+                                     ReftypeT reftype) {
+    CacheT *cache = thecache[level];
+    CacheAssociativityT candidate = assocFindEmpty (cache, where);
+    if (candidate < cache->associativity)
+        return candidate;
+    candidate = assocFindVictim (cache); // none invalid, choose a victim
+    // We need an address that takes us to the block we are evicting:
+    // reverse calculation we did to put in the address tag to maintain inclusion
+    // since other levels may have a different block size
+#ifdef DEBUG
+    fprintf(stderr, "replacing in way %d ", candidate);
+#endif
+    RawCacheT *rawcache = waysfor (cache, where)[candidate];
+    AddressT victimwhere = tagToAddress (rawcache, blockaddress (rawcache, where));
+    TagT victimtags = status (rawcache, victimwhere);
+    if (!(victimtags & VALID)) {
+        error (associativityError, false, "Associative cache victim should be valid",
+               __LINE__, __FILE__);
+    }
+    if (cache->owners)
+        cache->owners->evictions[thecache[0]->owner*thecache[0]->Nowners +
+                                 OWNEROF (victimtags)]++;
+    bool leaving = true; // does the victim leave this level?
+    if (cache->victims) {
+        leaving = victimPut (cache->victims, victimwhere, victimtags, &victimwhere, &victimtags);
+        if (leaving)
+            incrcount (cache->victimstats->replacecount, reftype);
+    }
+    if (leaving) {
+        if (thecache[0]->inclusion == inclusive &&
+            maintaininclusion (thecache, level, victimwhere, reftype))
+            victimtags |= MODIFIED;
+        if (thecache[0]->filter) // only L1 when filtering
+            filtervictim (thecache, victimwhere, victimtags);
+        // no longer at any upper level, if modified higher up, modified here now
+        if (victimtags & MODIFIED) {
+            dowrite (thecache[level+1], victimwhere); // in next level down if inclusive
+            // incur writeback penalty here; for now
+            // assume writebacks fully buffered so no write cost
+        }
+    }
+    invalidate (rawcache, where); // now free to use this block
+    incrcount (cache->stats->replacecount, reftype);
+    return candidate;
+}
+
+// In an exclusive hierarchy, a block found below L1 is moved rather than copied:
+// it is invalidated where found (keeping its modified state) and placed in L1 only.
+// Every level searched on the way down still incurs the same miss costs as in an
+// inclusive hierarchy. Lower levels are filled only by victims from the level
+// above, so there is never anything to back-invalidate. If block sizes differ,
+// moving a bigger block up drops the part of it that does not fit in L1 --
+// a simplification we accept rather than splitting blocks.
+static void handleExclusiveMiss (CacheT* thecache[], AddressT where, ReftypeT reftype,
+                                 int foundat, bool invictims) {
+    bool split = thecache[0]->split;
+    int offEdge = countlevels (thecache) + (split?1:0),
+        indexL1D = split?1:0;
+    TagT tags = ((reftype == WRITE)?MODIFIED:0) | thecache[0]->ownerbits;
+
+    if (invictims) {
+        TagT victimtags;
+        victimTake (thecache[foundat]->victims, where, &victimtags);
+        tags |= victimtags & MODIFIED;
+    } else if (foundat < offEdge) { // take it out of the level where it was found
+        RawCacheT *rawcache =
+            waysfor (thecache[foundat], where)[assocCacheHit (thecache[foundat], where)];
+        tags |= status (rawcache, where) & MODIFIED;
+        invalidate (rawcache, where);
+    }
+    for (int level = foundat-1; level >= indexL1D; level--) {
+        int i = level;
+        if (split && (reftype == FETCH) && (i == indexL1D))
+            i--;  // i == 1 for L1, fetch handled differently for split cache
+        LatencyT lookupcost = thecache[i]->lookupoverhead,
+                 misscost = thecache[i+1]->hittime + thecache[i+1]->lookupoverhead;
+        if (reftype == WRITE) {
+            incrDWcost (thecache[i]->stats->misscost, lookupcost + misscost);
+            incrDWcount (thecache[i]->stats->misscount);
+        } else if (reftype == READ) {
+            incrDRcost (thecache[i]->stats->misscost, lookupcost + misscost);
+            incrDRcount (thecache[i]->stats->misscount);
+        } else {
+            incrIcost (thecache[i]->stats->misscost, lookupcost + misscost);
+            incrIcount (thecache[i]->stats->misscount);
+        }
+        if (thecache[i]->owners)
+            thecache[i]->owners->misses[thecache[0]->owner]++;
+    }
+    if (!thecache[0]->prefiltered)
+        exclusiveFill (thecache, L1INDEX(thecache,reftype), where, tags, reftype);
+}
+
+// Put a block with the given tag bits (modified and owner) into a level of an
+// exclusive hierarchy.
+// If there is no free way, the victim moves down a level (see exclusiveDemote).
+static void exclusiveFill (CacheT* thecache[], int level, AddressT where, TagT tags,
+                           ReftypeT reftype) {
+    CacheT *cache = thecache[level];
+    CacheAssociativityT candidate = assocFindEmpty (cache, where);
+
+    if (candidate >= cache->associativity) { // none invalid, choose a victim
+        candidate = assocFindVictim (cache);
+        RawCacheT *rawcache = waysfor (cache, where)[candidate];
+        AddressT victimwhere = tagToAddress (rawcache, blockaddress (rawcache, where));
+        TagT victimtags = status (rawcache, victimwhere);
+        if (!(victimtags & VALID)) {
+            error (associativityError, false, "Associative cache victim should be valid",
+                   __LINE__, __FILE__);
+        }
+        invalidate (rawcache, where); // now free to use this block
+        incrcount (cache->stats->replacecount, reftype);
+        if (cache->owners)
+            cache->owners->evictions[thecache[0]->owner*thecache[0]->Nowners +
+                                     OWNEROF (victimtags)]++;
+        if (thecache[0]->filter) // only L1 when filtering
+            filtervictim (thecache, victimwhere, victimtags);
+        exclusiveDemote (thecache, level, victimwhere, victimtags & (MODIFIED|OWNERMASK),
+                         reftype);
+    }
+    RawCacheT *rawcache = waysfor (cache, where)[candidate];
+    insert (rawcache, where); // make the block valid and set the address bits
+    if (tags & (MODIFIED|OWNERMASK))
+        setbits (rawcache, blockaddress (rawcache, where), tags & (MODIFIED|OWNERMASK));
+}
+
+// A block evicted from a level of an exclusive hierarchy goes into the level's
+// victim cache if it has one (and whatever that pushes out carries on down);
+// otherwise it moves to the next level down (a victim fill, counted in that
+// level's inclusioncount) and so on down to the LLC, whose victims leave the
+// hierarchy (written back to DRAM if modified, at no cost as with other
+// writebacks). A victim already present below (e.g. from the other half of a
+// split L1) just merges its modified state into the copy there.
+static void exclusiveDemote (CacheT* thecache[], int level, AddressT where, TagT tags,
+                             ReftypeT reftype) {
+    CacheT *cache = thecache[level];
+    bool split = thecache[0]->split;
+    int offEdge = countlevels (thecache) + (split?1:0),
+        below = (split && level == 0)?2:level+1; // L1I and L1D both fill L2
+
+    if (cache->victims) {
+        if (!victimPut (cache->victims, where, tags, &where, &tags))
+            return;
+        incrcount (cache->victimstats->replacecount, reftype);
     }
-    return cache->associativity; // miss
+    if (below < offEdge) {
+        CacheAssociativityT way = assocCacheHit (thecache[below], where);
+        if (way < thecache[below]->associativity) {
+            if (tags & MODIFIED)
+                dowrite (thecache[below], where);
+        } else {
+            exclusiveFill (thecache, below, where, tags & (MODIFIED|OWNERMASK), reftype);
+            incrcount (thecache[below]->stats->inclusioncount, reftype);
+        }
+    }
+}
+
+CacheAssociativityT assocFindEmpty (CacheT* cache, AddressT address) {
+    return cache->findempty (waysfor (cache, address), cache->associativity, address);
 }
 
+// associativity need not be a power of 2, so can't just mask
 CacheAssociativityT assocFindVictim (CacheT* cache) {
-    return random() & cache->assocmask; // only get here if all ways occupied
+    return randombelow (cache->random, cache->associativity); // only get here if all ways occupied
 }
 
 //////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
@@ -455,6 +1145,7 @@ void reportstats (CacheT *cache[]) {
     int N = countlevels (cache), // 1 more than highest index in cache array
         L1Iindex = 0;
     ELAPSED totaltime       = 0,
+            totalqueue      = 0,
             totalhits       = 0,
             totalmisses     = 0,
             totalinclusions = 0,
@@ -464,11 +1155,15 @@ void reportstats (CacheT *cache[]) {
     if (splitL1) {
         N++;
     }
+    if (cache[L1Iindex]->victims) // neither a hit nor a miss in L1 itself
+        instructions += getIcount (cache[L1Iindex]->victimstats->hitcount);
 #ifdef DEBUG
     fprintf(stderr, "#####MAX HITCOST %lu######\n", maxhitcost);
 #endif
     int level = 1;
-    printf ("level\tHits\tmisses\tincl.\thit t\tmiss t\n");
+    // in an exclusive hierarchy inclusioncount holds victim fills instead
+    bool exclusiveL1 = cache[0]->inclusion == exclusive;
+    printf ("level\tHits\tmisses\t%s\thit t\tmiss t\n", exclusiveL1?"vict.":"incl.");
     for (int i = 0; i < N; i++) {
         ELAPSED misscost = 0, hitcost = 0,
             icost = 0,
@@ -491,6 +1186,42 @@ void reportstats (CacheT *cache[]) {
         inclusions += getDWcount(cache[i]->stats->inclusioncount);
         printf ("$[L%d%s]\t%lu\t%lu\t%lu\t%lu\t%lu\n",
             level, cache[0]->split?(i==0?"I":(i==1?"D":"")):"", hitcount, misscount, inclusions, hitcost, misscost);
+        if (cache[i]->victims) { // hits are costed in the level above, as for the level
+            AllStatsT *victimstats = cache[i]->victimstats;
+            ELAPSED victimhits = getIcount(victimstats->hitcount) +
+                                 getDRcount(victimstats->hitcount) +
+                                 getDWcount(victimstats->hitcount),
+                    victimmisses = getIcount(victimstats->misscount) +
+                                   getDRcount(victimstats->misscount) +
+                                   getDWcount(victimstats->misscount),
+                    victiminclusions = getIcount(victimstats->inclusioncount) +
+                                       getDRcount(victimstats->inclusioncount) +
+                                       getDWcount(victimstats->inclusioncount);
+            printf ("$[L%d%sV]\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+                level, cache[0]->split?(i==0?"I":(i==1?"D":"")):"", victimhits, victimmisses,
+                victiminclusions, 0ul, 0ul);
+            // a victim cache is only looked in after a miss in its level, so its
+            // misses are not misses of the hierarchy
+            totalhits   += victimhits;
+            totalinclusions += victiminclusions;
+        }
+        if (cache[i]->slicestats) { // already counted as the level's; only queueing is extra
+            printf ("slice\tHits\tmisses\tqueue t\n");
+            for (int slice = 0; slice < cache[i]->Nslices; slice++) {
+                AllStatsT *slicestats = cache[i]->slicestats[slice];
+                printf ("$[L%d%s.%d]\t%lu\t%lu\t%lu\n", level,
+                    cache[0]->split?(i==0?"I":(i==1?"D":"")):"", slice,
+                    getIcount(slicestats->hitcount) + getDRcount(slicestats->hitcount) +
+                        getDWcount(slicestats->hitcount),
+                    getIcount(slicestats->misscount) + getDRcount(slicestats->misscount) +
+                        getDWcount(slicestats->misscount),
+                    getIcount(slicestats->queuecost) + getDRcount(slicestats->queuecost) +
+                        getDWcount(slicestats->queuecost));
+            }
+            totalqueue += getIcount(cache[i]->stats->queuecost) +
+                          getDRcount(cache[i]->stats->queuecost) +
+                          getDWcount(cache[i]->stats->queuecost);
+        }
         if (i > 0)
             level++;
         else if (!splitL1)
@@ -500,36 +1231,334 @@ void reportstats (CacheT *cache[]) {
         totalmisses += misscount;
         totalinclusions += inclusions;
   }
-  printf ("Total elapsed time %lu, total hits %lu, total misses %lu, evictions for"
-          " inclusion %lu; instructions: %lu\n",
-          totaltime, totalhits, totalmisses, totalinclusions, instructions);
-}
-
-static AllStatsT* init_all_stats () {
-    AllStatsT* allstats = malloc (sizeof (AllStatsT));
-    allstats->hitcount = init_stats ();
-    allstats->misscount = init_stats ();
-    allstats->replacecount = init_stats ();
-    allstats->inclusioncount = init_stats ();
-    allstats->hitcost = init_stats ();
-    allstats->misscost = init_stats ();
+  if (cache[0]->tlbs)
+      totaltime += reporttlbs (cache[0]->tlbs);
+  printf ("Total elapsed time %lu, total hits %lu, total misses %lu, %s"
+          " %lu; instructions: %lu\n",
+          totaltime, totalhits, totalmisses,
+          exclusiveL1?"victim fills":"evictions for inclusion", totalinclusions, instructions);
+  if (totalqueue)
+      printf ("Slice queueing delay %lu (an estimate of contention, not in elapsed time)\n",
+              totalqueue);
+  if (cache[0]->filter || cache[0]->prefiltered)
+      reportfilter (cache);
+  if (cache[0]->Nowners)
+      reportowners (cache);
+}
+
+void reportstatsto (CacheT *cache[], ReportT *report) {
+    static const char *types [] = {"I", "DR", "DW"};
+    ELAPSED (*get [])(StatsT *) = {getIcount, getDRcount, getDWcount};
+    int N = countlevels (cache) + (cache[0]->split?1:0),
+        L1s = cache[0]->split?2:1;
+    bool exclusivefills = cache[0]->inclusion == exclusive;
+    ELAPSED time [3] = {0}, references [3] = {0},
+            hits = 0, misses = 0, inclusions = 0, queuetime = 0;
+    char unit [16];
+    for (int i = 0, level = 1; i < N; i++) {
+        AllStatsT *stats = cache[i]->stats;
+        snprintf (unit, sizeof (unit), "L%d%s", level,
+                  cache[0]->split?(i==0?"I":(i==1?"D":"")):"");
+        report_all_stats (report, unit, stats, exclusivefills);
+        for (int type = 0; type < 3; type++) {
+            time[type] += get[type] (stats->hitcost) + get[type] (stats->misscost);
+            queuetime += get[type] (stats->queuecost);
+            hits += get[type] (stats->hitcount);
+            misses += get[type] (stats->misscount);
+            inclusions += get[type] (stats->inclusioncount);
+            if (i < L1s)
+                references[type] += get[type] (stats->hitcount) + get[type] (stats->misscount);
+        }
+        if (cache[i]->victims) { // hits are costed in the level above, as in reportstats
+            char victimunit [sizeof (unit) + 1];
+            snprintf (victimunit, sizeof (victimunit), "%sV", unit);
+            report_all_stats (report, victimunit, cache[i]->victimstats, exclusivefills);
+            for (int type = 0; type < 3; type++) {
+                hits += get[type] (cache[i]->victimstats->hitcount);
+                inclusions += get[type] (cache[i]->victimstats->inclusioncount);
+                if (i < L1s) // neither a hit nor a miss in L1 itself
+                    references[type] += get[type] (cache[i]->victimstats->hitcount);
+            }
+        }
+        for (int slice = 0; cache[i]->slicestats && slice < cache[i]->Nslices; slice++) {
+            char sliceunit [sizeof (unit) + 12];
+            snprintf (sliceunit, sizeof (sliceunit), "%s.%d", unit, slice);
+            report_all_stats (report, sliceunit, cache[i]->slicestats[slice], exclusivefills);
+        }
+        if (i > 0 || !cache[0]->split)
+            level++;
+    }
+    if (cache[0]->Nowners)
+        reportownersto (cache, report);
+    if (cache[0]->tlbs)
+        reporttlbsto (cache[0]->tlbs, report, time);
+    if (cache[0]->filter) {
+        reportcount (report, "filter", "", "writebacks", cache[0]->filterwritebacks);
+        reportcount (report, "filter", "", "victims", cache[0]->filtervictims);
+    }
+    ELAPSED alltime = 0, allreferences = 0;
+    for (int type = 0; type < 3; type++) {
+        reportcount (report, "total", types[type], "time", time[type]);
+        reportcount (report, "total", types[type], "references", references[type]);
+        reportratio (report, "total", types[type], "amat",
+                     references[type] ? (double) time[type] / references[type] : 0.0);
+        alltime += time[type];
+        allreferences += references[type];
+    }
+    reportcount (report, "total", "", "time", alltime);
+    reportcount (report, "total", "", "queuetime", queuetime);
+    reportcount (report, "total", "", "hits", hits);
+    reportcount (report, "total", "", "misses", misses);
+    reportcount (report, "total", "", exclusivefills ? "victimfills" : "inclusions",
+                 inclusions);
+    reportcount (report, "total", "", "instructions", references[0]);
+    reportcount (report, "total", "", "references", allreferences);
+    reportratio (report, "total", "", "amat",
+                 allreferences ? (double) alltime / allreferences : 0.0);
+}
+
+int getlevelstats (CacheT *cache[], LevelstatsT stats[], int max) {
+    int N = countlevels (cache) + (cache[0]->split?1:0),
+        level = 1;
+    for (int i = 0; i < N && i < max; i++) {
+        AllStatsT *from = cache[i]->stats;
+        StatsT *counts [] = {from->hitcount, from->misscount, from->replacecount,
+                             from->inclusioncount, from->hitcost, from->misscost,
+                             from->queuecost};
+        ELAPSED *to [] = {stats[i].hits, stats[i].misses, stats[i].replacements,
+                          stats[i].inclusions, stats[i].hittime, stats[i].misstime,
+                          stats[i].queuetime};
+        for (int j = 0; j < sizeof (counts) / sizeof (StatsT*); j++) {
+            to[j][LEVELI] = getIcount (counts[j]);
+            to[j][LEVELDR] = getDRcount (counts[j]);
+            to[j][LEVELDW] = getDWcount (counts[j]);
+        }
+        snprintf (stats[i].name, sizeof (stats[i].name), "L%d%s", level,
+                  cache[0]->split?(i==0?"I":(i==1?"D":"")):"");
+        if (i > 0 || !cache[0]->split)
+            level++;
+    }
+    return N < max ? N : max;
+}
+
+static AllStatsT* init_all_stats (ArenaT *arena) {
+    AllStatsT* allstats = arenaalloc (arena, sizeof (AllStatsT));
+    allstats->hitcount = init_stats (arena);
+    allstats->misscount = init_stats (arena);
+    allstats->replacecount = init_stats (arena);
+    allstats->inclusioncount = init_stats (arena);
+    allstats->hitcost = init_stats (arena);
+    allstats->misscost = init_stats (arena);
+    allstats->queuecost = init_stats (arena);
     return allstats;
 }
 
-static void deconstruct_all_stats (AllStatsT* stats) {
-    deconstruct_stats(&(stats->hitcount));
-    deconstruct_stats(&(stats->misscount));
-    deconstruct_stats(&(stats->replacecount));
-    deconstruct_stats(&(stats->inclusioncount));
-    deconstruct_stats(&(stats->hitcost));
-    deconstruct_stats(&(stats->misscost));
+static size_t allstatsbytes () {
+    return arenabytes (sizeof (AllStatsT)) + 7*statsbytes ();
+}
+
+static void reset_all_stats (AllStatsT *allstats) {
+    reset_stats (allstats->hitcount);
+    reset_stats (allstats->misscount);
+    reset_stats (allstats->replacecount);
+    reset_stats (allstats->inclusioncount);
+    reset_stats (allstats->hitcost);
+    reset_stats (allstats->misscost);
+    reset_stats (allstats->queuecost);
+}
+
+static void report_all_stats (ReportT *report, const char *unit, AllStatsT *allstats,
+                              bool exclusivefills) {
+    static const char *types [] = {"I", "DR", "DW", ""}; // "" for the total
+    ELAPSED (*get [])(StatsT *) = {getIcount, getDRcount, getDWcount};
+    StatsT *counts [] = {allstats->hitcount, allstats->misscount, allstats->replacecount,
+                         allstats->inclusioncount, allstats->hitcost, allstats->misscost,
+                         allstats->queuecost};
+    const char *names [] = {"hits", "misses", "replacements",
+                            exclusivefills ? "victimfills" : "inclusions",
+                            "hittime", "misstime", "queuetime"};
+    for (int type = 0; type < 4; type++) {
+        ELAPSED values [sizeof (counts) / sizeof (StatsT*)];
+        for (int j = 0; j < sizeof (counts) / sizeof (StatsT*); j++) {
+            values[j] = type < 3 ? get[type] (counts[j]) :
+                        getIcount (counts[j]) + getDRcount (counts[j]) + getDWcount (counts[j]);
+            reportcount (report, unit, types[type], names[j], values[j]);
+        }
+        // values[0] and [1] are hits and misses
+        reportratio (report, unit, types[type], "missrate", values[0] + values[1] ?
+                     (double) values[1] / (values[0] + values[1]) : 0.0);
+    }
+}
+
+static void resetslicewindow (CacheT *level) {
+    for (int i = 0; i < level->slicewindow; i++)
+        level->recentslices[i] = level->Nslices; // none yet
+    for (int i = 0; i < level->Nslices; i++)
+        level->slicerequests[i] = 0;
+    level->nextrecent = 0;
+}
+
+static void filtervictim (CacheT* thecache[], AddressT where, TagT tags) {
+    bool modified = tags & MODIFIED;
+    deltaencode (thecache[0]->filter,
+                 (Trace) {modified?WRITEBACK:CLEANVICTIM, where, 1, 0});
+    if (modified)
+        thecache[0]->filterwritebacks++;
+    else
+        thecache[0]->filtervictims++;
+}
+
+// With inclusion, lower levels evict blocks from L1, which changes its later
+// misses: a stream made without them can only approximate that. Otherwise
+// what L1 holds doesn't depend on what is below it, so the stream is what L1
+// would pass down with the levels below simulated too: each level has its own
+// stream of random replacement choices, the same in both runs.
+static void reportfilter (CacheT* thecache[]) {
+    bool exact = thecache[0]->inclusion != inclusive;
+    if (thecache[0]->filter) {
+        ELAPSED references = 0, misses = 0;
+        for (int i = 0; i < (thecache[0]->split?2:1); i++) {
+            AllStatsT *stats = thecache[i]->stats;
+            misses += getIcount (stats->misscount) + getDRcount (stats->misscount) +
+                      getDWcount (stats->misscount);
+            references += getIcount (stats->hitcount) + getDRcount (stats->hitcount) +
+                          getDWcount (stats->hitcount);
+        }
+        references += misses;
+        printf ("L1 filter: %lu misses of %lu references (%.2f%%), %lu writebacks,"
+                " %lu clean victims written to %s\n", misses, references,
+                references?100.0*misses/references:0.0, thecache[0]->filterwritebacks,
+                thecache[0]->filtervictims, thecache[0]->filtername);
+    } else
+        printf ("L1 prefiltered: L1 hits not simulated, instructions are L1 misses\n");
+    printf ("Levels below L1 from the miss stream are %s\n", exact ?
+            "exact: L1 does not depend on lower levels" :
+            "approximate: an inclusive hierarchy back-invalidates L1, which the stream"
+            " does not capture");
+}
+
+static void ownerhit (CacheT* thecache[], CacheT *level, AddressT where,
+                      CacheAssociativityT way) {
+    TagT tags = status (waysfor (level, where)[way], where);
+    level->owners->hits[thecache[0]->owner*thecache[0]->Nowners + OWNEROF (tags)]++;
+}
+
+// A sample falls due at each multiple of the period, and is taken after the
+// record that reaches it: a run may take it a little past. Each level's counts
+// are copied, so taking a sample touches none of the tag arrays.
+static void sampleoccupancy (CacheT* thecache[], unsigned long references) {
+    CacheT *first = thecache[0];
+    unsigned N = first->Nowners;
+    int Nlevels = countlevels (thecache) + (first->split?1:0);
+    first->sampled += references;
+    first->sincesample += references;
+    if (first->sincesample < first->occupancyperiod)
+        return;
+    first->sincesample %= first->occupancyperiod;
+    size_t samplesize = (size_t) Nlevels*N;
+    unsigned long *blocks = &first->occupancy[first->Nsamples*samplesize];
+    for (int i = 0; i < Nlevels; i++)
+        memcpy (&blocks[i*N], thecache[i]->owners->blocks, sizeof (unsigned long)*N);
+    first->sampledat[first->Nsamples++] = first->sampled;
+    if (first->Nsamples == MAXOCCUPANCYSAMPLES) {
+        // keep the samples at multiples of twice the period (the odd ones), as
+        // if that had been the period all along: the last, just taken, is one,
+        // so the count since it stands
+        for (unsigned sample = 1; sample < MAXOCCUPANCYSAMPLES; sample += 2) {
+            first->sampledat[sample/2] = first->sampledat[sample];
+            memcpy (&first->occupancy[sample/2*samplesize],
+                    &first->occupancy[sample*samplesize], sizeof (unsigned long)*samplesize);
+        }
+        first->Nsamples /= 2;
+        first->occupancyperiod *= 2;
+    }
+}
+
+static void levelname (CacheT* thecache[], int i, char *name, size_t size) {
+    bool split = thecache[0]->split;
+    snprintf (name, size, "L%d%s", split ? (i < 2 ? 1 : i) : i+1,
+              split?(i==0?"I":(i==1?"D":"")):"");
+}
+
+static void reportowners (CacheT* thecache[]) {
+    CacheT *first = thecache[0];
+    unsigned N = first->Nowners;
+    int Nlevels = countlevels (thecache) + (first->split?1:0);
+    char name [16];
+    printf ("owner\thits on blocks of 0..%u\tmisses\tevicted blocks of 0..%u\tblocks\n",
+            N-1, N-1);
+    for (int i = 0; i < Nlevels; i++) {
+        OwnerstatsT *owners = thecache[i]->owners;
+        levelname (thecache, i, name, sizeof (name));
+        for (unsigned owner = 0; owner < N; owner++) {
+            printf ("$[%s].%u\t", name, owner);
+            for (unsigned of = 0; of < N; of++)
+                printf ("%s%lu", of?" ":"", owners->hits[owner*N + of]);
+            printf ("\t%lu\t", owners->misses[owner]);
+            for (unsigned of = 0; of < N; of++)
+                printf ("%s%lu", of?" ":"", owners->evictions[owner*N + of]);
+            printf ("\t%lu\n", owners->blocks[owner]);
+        }
+    }
+    if (!first->Nsamples)
+        return;
+    printf ("occupancy: blocks of owners 0..%u every %lu references\nreferences", N-1,
+            first->occupancyperiod);
+    for (int i = 0; i < Nlevels; i++) {
+        levelname (thecache, i, name, sizeof (name));
+        printf ("\t$[%s]", name);
+    }
+    for (unsigned sample = 0; sample < first->Nsamples; sample++) {
+        printf ("\n%lu", first->sampledat[sample]);
+        unsigned long *blocks = &first->occupancy[(size_t) sample*Nlevels*N];
+        for (int i = 0; i < Nlevels; i++)
+            for (unsigned owner = 0; owner < N; owner++)
+                printf ("%s%lu", owner?" ":"\t", blocks[i*N + owner]);
+    }
+    printf ("\n");
+}
+
+static void reportownersto (CacheT* thecache[], ReportT *report) {
+    CacheT *first = thecache[0];
+    unsigned N = first->Nowners;
+    int Nlevels = countlevels (thecache) + (first->split?1:0);
+    char name [16], unit [32], valuename [32];
+    for (int i = 0; i < Nlevels; i++) {
+        OwnerstatsT *owners = thecache[i]->owners;
+        levelname (thecache, i, name, sizeof (name));
+        for (unsigned owner = 0; owner < N; owner++) {
+            ELAPSED hits = 0;
+            snprintf (unit, sizeof (unit), "%s.p%u", name, owner);
+            for (unsigned of = 0; of < N; of++) {
+                snprintf (valuename, sizeof (valuename), "hitson%u", of);
+                reportcount (report, unit, "", valuename, owners->hits[owner*N + of]);
+                hits += owners->hits[owner*N + of];
+            }
+            reportcount (report, unit, "", "hits", hits);
+            reportcount (report, unit, "", "misses", owners->misses[owner]);
+            for (unsigned of = 0; of < N; of++) {
+                snprintf (valuename, sizeof (valuename), "evicts%u", of);
+                reportcount (report, unit, "", valuename, owners->evictions[owner*N + of]);
+            }
+            reportcount (report, unit, "", "blocks", owners->blocks[owner]);
+            for (unsigned sample = 0; sample < first->Nsamples; sample++) {
+                snprintf (valuename, sizeof (valuename), "blocks@%lu",
+                          first->sampledat[sample]);
+                reportcount (report, unit, "", valuename,
+                             first->occupancy[((size_t) sample*Nlevels + i)*N + owner]);
+            }
+        }
+    }
 }
 
 // write in a given level; in main memory, associativity is set to 0 so nothing happens
 static void dowrite (CacheT *level, AddressT where) {
+    if (!level->associativity)
+        return;
+    RawCacheT **ways = waysfor (level, where);
     for (int i = 0; i < level->associativity; i++) {
-        if (rawCacheHit (level->cachedata[i], where)) {
-            setbits (level->cachedata[i], blockaddress (level->cachedata[i], where),
+        if (rawCacheHit (ways[i], where)) {
+            setbits (ways[i], blockaddress (ways[i], where),
                      MODIFIED);
             return;
         }
@@ -544,9 +1573,11 @@ static void dowrite (CacheT *level, AddressT where) {
 // If any levels below a given one have a bigger block size, need to remove
 // all additional blocks not just the one containing the address of interest.
 // Does not invalidate the level that triggered this: must fix up there.
-static void maintaininclusion (CacheT* multilevelcache [], int misslevel, AddressT where,
+// Returns true if any copy removed was modified.
+static bool maintaininclusion (CacheT* multilevelcache [], int misslevel, AddressT where,
                                ReftypeT reftype) {
     LatencyT writecosts = 0;
+    bool modified = false;
     BlocksizeT biggestbelow = BLOCKSIZE(multilevelcache,misslevel);
     for (int i = misslevel-1; i >=0; i--) {
         if (BLOCKSIZE(multilevelcache,i) > biggestbelow) {
@@ -570,10 +1601,12 @@ static void maintaininclusion (CacheT* multilevelcache [], int misslevel, Addres
         }
 
         for (int way = 0; way < multilevelcache[i]->associativity; way++) {
-            RawCacheT *thisway = multilevelcache[i]->cachedata[way];
             for (int j = 0; j < blocks; j++) {
+                // blocks further on may be in a different slice
+                RawCacheT *thisway = waysfor (multilevelcache[i], place)[way];
                 if (rawCacheHit (thisway, place)) {
                     if (mustWriteback (thisway, place)) {
+                        modified = true;
                         // this will work even if i+1 is DRAM layer
                         dowrite (multilevelcache[i+1], place);
                         // writecosts should increment here if any delay
@@ -594,6 +1627,24 @@ static void maintaininclusion (CacheT* multilevelcache [], int misslevel, Addres
                 place += blocksize;   // push into next block
             }
         }
+        // anything in this level's victim cache is still in the level
+        if (multilevelcache[i]->victims) {
+            AddressT place = where;
+            if (biggestbelow > blocksize)
+                place = (place >> calculateOffsetBits (biggestbelow)) <<
+                        calculateOffsetBits (biggestbelow);
+            for (int j = 0; j < blocks; j++) {
+                TagT tags;
+                if (victimTake (multilevelcache[i]->victims, place, &tags)) {
+                    if (tags & MODIFIED) {
+                        modified = true;
+                        dowrite (multilevelcache[i+1], place);
+                    }
+                    incrcount (multilevelcache[i]->victimstats->inclusioncount, reftype);
+                }
+                place += blocksize;
+            }
+        }
     }
     // account for look up costs at the level that caused the miss
     if (reftype == FETCH)
@@ -602,7 +1653,71 @@ static void maintaininclusion (CacheT* multilevelcache [], int misslevel, Addres
         incrDRcost (multilevelcache[misslevel]->stats->misscost, maxlookupcost);
     else
         incrDWcost (multilevelcache[misslevel]->stats->misscost, maxlookupcost);
+    return modified;
+}
+
+// hash the block number at this level's block size (murmur3 finalizer, so slices
+// are chosen by all the address bits, not only low ones) and scale it to a slice
+static RawCacheT **waysfor (CacheT *cache, AddressT where) {
+    if (cache->Nslices == 1)
+        return cache->cachedata;
+    AddressT hash = where >> cache->sliceshift;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    unsigned slice = ((unsigned long long) hash * cache->Nslices) >> 32;
+    return &cache->cachedata[slice*cache->associativity];
+}
+
+// Contention model: a slice serves one request at a time, for the level's hit
+// time. Time is measured in requests to the level, so each earlier request to the
+// same slice among the last slicewindow requests to the level delays this one by
+// a hit time. References are otherwise simulated one at a time, so there is no
+// timeline on which slices could be busy: this only estimates how unevenly
+// requests spread over slices, and is kept out of the elapsed time.
+static CacheAssociativityT probe (CacheT *cache, AddressT where, ReftypeT reftype) {
+    CacheAssociativityT way = assocCacheHit (cache, where);
+    if (cache->Nslices == 1)
+        return way;
+    unsigned slice = (waysfor (cache, where) - cache->cachedata) / cache->associativity;
+    AllStatsT *slicestats = cache->slicestats[slice];
+    if (way < cache->associativity)
+        incrcount (slicestats->hitcount, reftype);
+    else
+        incrcount (slicestats->misscount, reftype);
+    ELAPSED delay = cache->slicerequests[slice] * cache->hittime;
+    if (delay) {
+        incrcost (slicestats->queuecost, reftype, delay);
+        incrcost (cache->stats->queuecost, reftype, delay);
+    }
+    // slide the window along by one request
+    unsigned oldest = cache->recentslices[cache->nextrecent];
+    if (oldest < cache->Nslices)
+        cache->slicerequests[oldest]--;
+    cache->recentslices[cache->nextrecent] = slice;
+    cache->slicerequests[slice]++;
+    cache->nextrecent = (cache->nextrecent + 1) % cache->slicewindow;
+    return way;
+}
 
+static void incrcount (StatsT *stats, ReftypeT reftype) {
+    if (reftype == WRITE)
+        incrDWcount (stats);
+    else if (reftype == READ)
+        incrDRcount (stats);
+    else
+        incrIcount (stats);
+}
+
+static void incrcost (StatsT *stats, ReftypeT reftype, ELAPSED cost) {
+    if (reftype == WRITE)
+        incrDWcost (stats, cost);
+    else if (reftype == READ)
+        incrDRcost (stats, cost);
+    else
+        incrIcost (stats, cost);
 }
 
 //////////////////////////////////// UNIT TEST DRIVER ////////////////////////////////////
@@ -659,10 +1774,8 @@ const Trace tracerecord[] = {
 };
     
 CacheT** createExample (const char *lines []) {
-    CacheSetupT** setup = NULL;
-    for (int i = 0; lines[i]; i++)
-         setup = addCacheParameters (setup, makeCacheParametersStr((char*)(lines[i])));
-    CacheT** example = initmultilevelcache (setup);
+    CacheSetupT** setup = getconfig ((char**) lines);
+    CacheT** example = initmultilevelcache (setup, 0);
     deconstruct_setup (setup);
     return example;
 }
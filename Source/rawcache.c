@@ -15,6 +15,7 @@
 
 #include <stdlib.h> // malloc
 #include <stdio.h>  // for testing
+#include <stdint.h> // for 64-bit reciprocal
 
 /////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
 //////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
@@ -35,6 +36,10 @@ typedef struct RawCache {
            indexmask;
   Bitshift offsetbits,
            indexbits;
+  IndexfunctionT indexfunction;
+  unsigned way;        // which hash for skewindex
+  uint64_t reciprocal; // 2^64/Nblocks rounded up, for modindex
+  unsigned long *owned; // valid blocks by owner, NULL unless counted (setownercounts)
 } RawCacheT;
 
 
@@ -44,13 +49,16 @@ static CachesizeT storedaddress (RawCacheT* thecache, AddressT where);
 
 static void rawinvalidate (RawCacheT* thecache, CachesizeT whichblock);
 
-static void invalidblock (CacheblockT * block);
+static void invalidblock (RawCacheT* thecache, CacheblockT * block);
 
 // turn on given tags leaving any others unchanged
-static void settags (CacheblockT * block, TagT tags);
+static void settags (RawCacheT* thecache, CacheblockT * block, TagT tags);
 
 // only turn on given tags, ensure the rest are 0
-static void settagsexclusive (CacheblockT * block, TagT tags);
+static void settagsexclusive (RawCacheT* thecache, CacheblockT * block, TagT tags);
+
+// every change to a block's tags goes through here, to keep owner counts
+static void retag (RawCacheT* thecache, CacheblockT * block, TagT tags);
 
 static AddressT getAddressMask (BlocksizeT blocksize);
 
@@ -62,47 +70,114 @@ static Bitshift calculateIndexBits (CachesizeT Nblocks);
 
 static Bitshift calculateOffsetBits (BlocksizeT blocksize);
 
+// block number modulo Nblocks using the precomputed reciprocal
+static CachesizeT fastmod (RawCacheT* thecache, AddressT block);
+
+// a different well-mixed hash of the block number for each way
+static AddressT skewhash (AddressT block, unsigned way);
+
+// set probe kernels (see SetprobeT) for any number of ways: where indexes the
+// same in every way, or not (skewindex)
+static unsigned anyfind (RawCacheT *ways[], unsigned Nways, AddressT where);
+static unsigned anyempty (RawCacheT *ways[], unsigned Nways, AddressT where);
+static unsigned skewfind (RawCacheT *ways[], unsigned Nways, AddressT where);
+static unsigned skewempty (RawCacheT *ways[], unsigned Nways, AddressT where);
+
+// kernels for maskindex and N ways, N a constant: Nways is ignored. Only the
+// number of ways is fixed: the offset and index bits are the level's, read
+// from the first way once per probe
+#define MASKKERNELS(N) \
+static unsigned maskfind##N (RawCacheT *ways[], unsigned Nways, AddressT where) { \
+    AddressT block = where >> ways[0]->offsetbits, \
+             tag = block >> ways[0]->indexbits; \
+    CachesizeT index = block & ways[0]->indexmask; \
+    for (unsigned i = 0; i < N; i++) \
+        if ((ways[i]->blocks[index].tags & VALID) && \
+            ways[i]->blocks[index].addressbits == tag) \
+            return i; \
+    return N; \
+} \
+static unsigned maskempty##N (RawCacheT *ways[], unsigned Nways, AddressT where) { \
+    CachesizeT index = (where >> ways[0]->offsetbits) & ways[0]->indexmask; \
+    for (unsigned i = 0; i < N; i++) \
+        if (!(ways[i]->blocks[index].tags & VALID)) \
+            return i; \
+    return N; \
+}
+
+MASKKERNELS(1)
+MASKKERNELS(2)
+MASKKERNELS(4)
+MASKKERNELS(8)
+MASKKERNELS(16)
+
+static const struct {
+    unsigned Nways;
+    SetprobeT find,
+              findempty;
+} maskkernels [] = {{1, maskfind1, maskempty1}, {2, maskfind2, maskempty2},
+                    {4, maskfind4, maskempty4}, {8, maskfind8, maskempty8},
+                    {16, maskfind16, maskempty16}};
+
+#define Nmaskkernels (sizeof (maskkernels) / sizeof (maskkernels[0]))
+
 
 //////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
 //////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
 
+size_t rawcachebytes (CachesizeT blocks) {
+    return arenabytes (sizeof (RawCacheT)) + arenabytes (sizeof (CacheblockT)*blocks);
+}
+
 // initialize raw cache
-RawCacheT* initrawcache (CachesizeT blocks, BlocksizeT blocksize) {
-    if (!checkPowerof2 (blocks))
+RawCacheT* initrawcache (CachesizeT blocks, BlocksizeT blocksize, ArenaT *arena) {
+    return initrawcacheindexed (blocks, blocksize, maskindex, 0, arena);
+}
+
+RawCacheT* initrawcacheindexed (CachesizeT blocks, BlocksizeT blocksize,
+                                IndexfunctionT indexfunction, unsigned way,
+                                ArenaT *arena) {
+    if ((indexfunction == maskindex || indexfunction == xorindex) && !checkPowerof2 (blocks))
         error (badblockcount, true, "Block count must be a power of two", __LINE__, __FILE__);
+    if (!blocks)
+        error (badblockcount, false, "Block count must be at least 1", __LINE__, __FILE__);
     if (!checkPowerof2 (blocksize))
         error (badblockcount, 0, "Block size must be a power of two", __LINE__, __FILE__);
 
-    RawCacheT *newcache = malloc (sizeof (RawCacheT));
+    RawCacheT *newcache = arenaalloc (arena, sizeof (RawCacheT));
     newcache->Nblocks = blocks;
     newcache->blocksize = blocksize;
-    // allocate blocks memory
-    newcache->blocks = malloc (sizeof (CacheblockT)*blocks);
+    // allocate blocks memory: the arena's is zero, so all INVALID to start with
+    // and not even touched until a reference reaches the set
+    newcache->blocks = arenaalloc (arena, sizeof (CacheblockT)*blocks);
     // calculate offsetbits and addressmask
     newcache->offsetbits = calculateOffsetBits (blocksize);
     newcache->indexbits = calculateIndexBits (blocks);
     newcache->addressmask = getAddressMask (blocksize);
     newcache->indexmask = getIndexMask (blocks);
-    // invalidate all blocks for correct initial state 
-    for (int i = 0; i < blocks; i++) {
-        rawinvalidate (newcache, i); // all bits off
-    }
+    newcache->indexfunction = indexfunction;
+    newcache->way = way;
+    newcache->reciprocal = UINT64_MAX / blocks + 1;
+    newcache->owned = NULL;
     return newcache;
 }
 
+// all INVALID is all zero, as when new
+void flushrawcache (RawCacheT *cache) {
+    arenazero (cache->blocks, sizeof (CacheblockT)*cache->Nblocks);
+}
+
 BlocksizeT getblocksize (RawCacheT *cache) {
    return cache->blocksize;
 }
 
-void deconstruct_cache (RawCacheT **cache) {
-   free ((*cache)->blocks);
-   free (*cache); // pointer now invalid so set it NULL
-   *cache = NULL;
+void setownercounts (RawCacheT* thecache, unsigned long owned []) {
+    thecache->owned = owned;
 }
 
 void setbits (RawCacheT* thecache, CachesizeT whichblock, TagT tags) {
     if (whichblock < thecache->Nblocks)
-        settags (&(thecache->blocks[whichblock]), tags);
+        settags (thecache, &(thecache->blocks[whichblock]), tags);
     else
         error (badblockindex, true, "Block index out of range", __LINE__, __FILE__);
 }
@@ -146,11 +221,12 @@ bool rawcachecheck (RawCacheT *cache) {
 // invalidating or writing back
 void insert (RawCacheT* thecache, AddressT where) {
      CachesizeT whichblock = blockaddress (thecache, where);
-     settagsexclusive (&thecache->blocks[whichblock], VALID); // only VALID bit on
+     settagsexclusive (thecache, &thecache->blocks[whichblock], VALID); // only VALID bit on
      thecache->blocks[whichblock].addressbits =
          storedaddress (thecache, where);
-if (!thecache->blocks[whichblock].addressbits) printf("0 addr tag, address is 0x%x\n", where);
 #ifdef DEBUG
+     if (!thecache->blocks[whichblock].addressbits)
+         fprintf(stderr, "0 addr tag, address is 0x%x\n", where);
      fprintf(stderr, "offset bits %u, index mask 0x%x; storing addr 0x%x at block 0x%x with address bits 0x%x\n",
              thecache->offsetbits, thecache->indexmask,
              where, whichblock, thecache->blocks[whichblock].addressbits);
@@ -173,9 +249,42 @@ TagT status (RawCacheT* thecache, AddressT where) {
    return thecache->blocks[whichblock].tags;
 }
 
+void setprobesfor (RawCacheT *ways[], unsigned Nways, SetprobeT *find,
+                   SetprobeT *findempty) {
+    *find = anyfind;
+    *findempty = anyempty;
+    if (ways[0]->indexfunction == skewindex) {
+        *find = skewfind;
+        *findempty = skewempty;
+    } else if (ways[0]->indexfunction == maskindex)
+        for (int i = 0; i < Nmaskkernels; i++)
+            if (maskkernels[i].Nways == Nways) {
+                *find = maskkernels[i].find;
+                *findempty = maskkernels[i].findempty;
+            }
+}
+
 // which block does this address fall in?
 CachesizeT blockaddress (RawCacheT* thecache, AddressT where) {
-    return ((thecache->addressmask & where) >> thecache->offsetbits) & thecache->indexmask;
+    AddressT block = where >> thecache->offsetbits;
+    CachesizeT index = 0;
+    switch (thecache->indexfunction) {
+    case maskindex:
+        return ((thecache->addressmask & where) >> thecache->offsetbits) & thecache->indexmask;
+    case xorindex: // fold indexbits at a time into the index
+        if (!thecache->indexbits)
+            return 0;
+        while (block) {
+            index ^= block & thecache->indexmask;
+            block >>= thecache->indexbits;
+        }
+        return index;
+    case modindex:
+        return fastmod (thecache, block);
+    case skewindex: // scale the hash into range rather than take the low bits
+        return ((uint64_t) skewhash (block, thecache->way) * thecache->Nblocks) >> 32;
+    }
+    return 0;
 }
 
 // returns true only if passed in val is a power of 2
@@ -208,6 +317,8 @@ AddressT getTagAddressBits (RawCacheT* thecache, unsigned index) {
 // this will not give the start address of the block
 AddressT tagToAddress (RawCacheT* thecache, unsigned index) {
     AddressT addressbits = thecache->blocks[index].addressbits;
+    if (thecache->indexfunction != maskindex) // whole block number stored
+        return addressbits << thecache->offsetbits;
     return (((addressbits << thecache->indexbits)  | index ) << 
               thecache->offsetbits);
 }
@@ -217,28 +328,59 @@ AddressT tagToAddress (RawCacheT* thecache, unsigned index) {
 
 static void rawinvalidate (RawCacheT* thecache, CachesizeT whichblock) {
     if (whichblock <= thecache->Nblocks)
-        invalidblock (&(thecache->blocks[whichblock]));
+        invalidblock (thecache, &(thecache->blocks[whichblock]));
     else 
         error (badblockindex, false, "Block index out of range", __LINE__, __FILE__);
 }
 
-static void invalidblock (CacheblockT * block) {
-    block->tags = INVALID;  // turn off all bits including VALID
+static void invalidblock (RawCacheT* thecache, CacheblockT * block) {
+    retag (thecache, block, INVALID);  // turn off all bits including VALID
     block->addressbits = 0; // unnecessary but safer
 }
 
 static CachesizeT storedaddress (RawCacheT* thecache, AddressT where) {
+    if (thecache->indexfunction != maskindex) // index bits can't be recovered from the index
+        return where >> thecache->offsetbits;
     return (where >> thecache->offsetbits) >> thecache->indexbits;
 }
 
+// Lemire's fastmod: the low 64 bits of block*reciprocal are the fraction part of
+// block/Nblocks, so scaling that back up by Nblocks gives the remainder exactly
+// for any 32-bit block number
+static CachesizeT fastmod (RawCacheT* thecache, AddressT block) {
+    uint64_t fraction = thecache->reciprocal * block;
+    return ((unsigned __int128) fraction * thecache->Nblocks) >> 64;
+}
+
+// murmur3 finalizer on the block number offset by a different constant per way
+static AddressT skewhash (AddressT block, unsigned way) {
+    AddressT hash = block ^ (way * 0x9e3779b9u);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
 // turn on given tags leaving any others unchanged
-static void settags (CacheblockT * block, TagT tags) {
-    block->tags |= tags; // turn on given tags, leave rest uncahnged
+static void settags (RawCacheT* thecache, CacheblockT * block, TagT tags) {
+    retag (thecache, block, block->tags | tags); // turn on given tags, leave rest uncahnged
 }
 
 // only turn on given tags, ensure the rest are 0
-static void settagsexclusive (CacheblockT * block, TagT tags) {
-    block->tags = tags; // turn on only given tags, turn off rest
+static void settagsexclusive (RawCacheT* thecache, CacheblockT * block, TagT tags) {
+    retag (thecache, block, tags); // turn on only given tags, turn off rest
+}
+
+static void retag (RawCacheT* thecache, CacheblockT * block, TagT tags) {
+    if (thecache->owned) {
+        if (block->tags & VALID)
+            thecache->owned[OWNEROF (block->tags)]--;
+        if (tags & VALID)
+            thecache->owned[OWNEROF (tags)]++;
+    }
+    block->tags = tags;
 }
 
 static AddressT getAddressMask (BlocksizeT blocksize) {
@@ -289,6 +431,37 @@ static Bitshift calculateOffsetBits (BlocksizeT blocksize) {
     return bits;
 }
 
+static unsigned anyfind (RawCacheT *ways[], unsigned Nways, AddressT where) {
+    CachesizeT index = blockaddress (ways[0], where);
+    AddressT tag = storedaddress (ways[0], where);
+    for (unsigned i = 0; i < Nways; i++)
+        if ((ways[i]->blocks[index].tags & VALID) && ways[i]->blocks[index].addressbits == tag)
+            return i;
+    return Nways;
+}
+
+static unsigned anyempty (RawCacheT *ways[], unsigned Nways, AddressT where) {
+    CachesizeT index = blockaddress (ways[0], where);
+    for (unsigned i = 0; i < Nways; i++)
+        if (!(ways[i]->blocks[index].tags & VALID))
+            return i;
+    return Nways;
+}
+
+static unsigned skewfind (RawCacheT *ways[], unsigned Nways, AddressT where) {
+    for (unsigned i = 0; i < Nways; i++)
+        if (rawCacheHit (ways[i], where))
+            return i;
+    return Nways;
+}
+
+static unsigned skewempty (RawCacheT *ways[], unsigned Nways, AddressT where) {
+    for (unsigned i = 0; i < Nways; i++)
+        if (!(status (ways[i], where) & VALID))
+            return i;
+    return Nways;
+}
+
 //////////////////////////////////// UNIT TEST DRIVER ////////////////////////////////////
 
 #ifdef UNITTESTRAWCACHETYPES
@@ -316,3 +489,4 @@ int main () {
 }
 
 #endif // UNITTESTRAWCACHETYPES
+
@@ -2,7 +2,8 @@
  * readtrace.c
  *
  * Types and operations for reading in a trace file
- * in format [IWRX] hex number where:
+ * in format [IWRX] hex number, optionally followed by ,size in bytes accessed
+ * (decimal), where:
  * I means instruction reference (never modified)
  * W means data write (memory modified at that address)
  * R means data read (that address accessed but unchanged)
@@ -11,6 +12,30 @@
  * terminates either on a line starting with # or on EOF
  * does not check contents
  *
+ * Reads a large buffer at a time and decodes it into a chunk of records, with
+ * the same result as reading each record with fscanf "%c %x\n": the usual line
+ * of a type, a space and up to 16 hex digits has a fast path that finds the end
+ * of the line with SSE2 compares (where available) and checks and decodes the
+ * hex digits 8 at a time in a 64-bit word; anything else goes through a scalar
+ * parser that follows fscanf's rules.
+ *
+ * Each trace has a reader thread that does the reading and decoding into a ring
+ * of preallocated chunks, handed to the simulator through a single-producer
+ * single-consumer queue of two counters, so the simulator only synchronizes
+ * with it once per chunk, and only waits if it gets ahead of the reader. A
+ * trace's thread, text buffer and ring are only set up when the trace is first
+ * read, and freed once it has been read to the end, so a workload of many
+ * traces run one after another only has one reading at a time.
+ *
+ * A trace starting with DELTAMAGIC is in the binary delta format instead.
+ *
+ * Traces from tools are read directly, detected from their first line: Valgrind
+ * Lackey (--trace-mem=yes) and the text output of DynamoRIO's memtrace samples.
+ * Each line is parsed in place in the text buffer, so these need no more
+ * memory than the usual format.
+ * settraceformat skips the detection, e.g. for a tool's trace whose first
+ * line is unusual.
+ *
  * Author: Philip Machanick
  * Created: 5 January 2012
  * Exceptions added: 8 March 2013
@@ -23,27 +48,230 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h> // memmove, memchr, memcpy
+#include <ctype.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>  // sched_yield
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "readtrace.h"
 #include "workload.h"
+#include "deltatrace.h"
+#include "error.h"
 
 typedef enum {invalid, unused, used} Tracestates;
 
+// text read at a time, and records decoded from it at a time, per trace
+#define TEXTBUFFERSIZE (1<<20)
+#define CHUNKRECORDS   4096
+// spare bytes either side of the text so that word and vector loads can run
+// off either end of it
+#define TEXTPADDING    16
+// chunks the reader thread can get ahead by
+#define RINGCHUNKS     4
+// keep the counters each side writes on separate cache lines
+#define CACHELINE      64
+
+typedef struct {
+	Trace *records;
+	int Nrecords;
+} Tracechunk;
+
+// decode a line of a tool's trace, from line to end (the newline or end of
+// text), into up to MAXLINERECORDS records; returns how many, 0 if the line
+// is not an sizedrecord (e.g. a tool's messages)
+typedef int (*Lineparser) (const char *line, const char *end, Trace *records);
+#define MAXLINERECORDS 2
+// low bits of a tool's 64-bit address kept as they are (see foldaddress)
+#define FOLDKEEPBITS   21
+
 typedef struct {
 	FILE *tracefile;
 	Trace record;
 	Tracestates validity;
+	// only used by the reader thread
+	char *buffer;        // text starts TEXTPADDING bytes in
+	size_t start,        // next text to parse
+	       parseend,     // end of the whole lines read so far, or of the text at EOF
+	       length;       // text read
+	bool ateof,          // no more to read from the file
+	     ended;          // trace has ended: nothing more to parse
+	DeltaDecoderT *decoder; // NULL unless in the binary delta format
+	Lineparser parseline;   // NULL unless a tool's trace
+	bool started;        // reader running, with buffer and ring allocated
+	pthread_t reader;
+	// the queue: chunk i is in ring[i % RINGCHUNKS]; the reader fills chunks and
+	// only advances filled, the simulator empties them and only advances emptied
+	Tracechunk ring [RINGCHUNKS];
+	_Alignas(CACHELINE) atomic_size_t filled;
+	_Alignas(CACHELINE) atomic_size_t emptied;
+	atomic_bool stop;    // tells the reader to give up, e.g. if the trace isn't finished
+	// only used by the simulator
+	_Alignas(CACHELINE) Tracechunk *current; // NULL if none taken from the queue
+	int nextrecord;
+	bool finished;       // the end of the trace has been returned
+	Trace run;           // next_addr: the run being returned a reference at a time
+	unsigned runleft;    // references of it not returned yet
 } Traceinfo;
 
+typedef enum {parsed, endoftrace, needmore} Parseresult;
+
 static Traceinfo *tracestate = NULL;
+static PID Ntraces = 0;
+static TraceformatT traceformatset = autotrace;
+
+// reader thread: decode a trace into chunks until it ends or is stopped
+static void *readtrace (void *trace);
+
+// the chunk records are being taken from, waiting for the reader if necessary;
+// NULL once the end of the trace has been returned
+static Tracechunk *currentchunk (Traceinfo *trace);
+
+// decode up to max records into records; at the end of the trace, the last
+// record returned has type EOFSYMBOL
+static int parsechunk (Traceinfo *trace, Trace *records, int max);
+
+// as parsechunk for the binary delta format
+static int deltachunk (Traceinfo *trace, Trace *records, int max);
+
+// as parsechunk for a tool's trace, a line at a time
+static int linechunk (Traceinfo *trace, Trace *records, int max);
+
+// the parser for the format of a tool's trace starting at text, or NULL if the
+// trace is in the usual format
+static Lineparser traceformat (const char *text, size_t length);
+
+// Lackey: "I  0400d7d4,8" for a fetch, " L ", " S " or " M " for a load, store
+// or modify (a load then a store) of data
+static int lackeyline (const char *line, const char *end, Trace *records);
+
+// DynamoRIO memtrace: "0x00007f0a1c2b3d40:  8, r" for a read, w for a write or
+// an opcode name for an instruction fetch
+static int memtraceline (const char *line, const char *end, Trace *records);
+
+// a record of an access of size bytes from addr
+static Trace sizedrecord (ReftypeT reftype, unsigned long addr, unsigned long size);
+
+// A tool's 64-bit address in 32 bits: one under 4G is unchanged; otherwise a
+// hash of its high word, times 2^FOLDKEEPBITS, is added to its low word. So
+// addresses with the same high word keep their distance apart and their low
+// FOLDKEEPBITS bits (offsets in 2MB pages, and set indexes of all but huge
+// ways), while regions with different high words (stack at 0x7ff..., text and
+// heap at 0x55...) land at unrelated places instead of on top of each other.
+// They can still overlap by chance, far less often than by dropping the
+// high word.
+static unsigned foldaddress (unsigned long addr);
+
+// hex or decimal digits from *p, moving *p past them: false if there are none
+static bool gethex (const char **p, const char *end, unsigned long *value);
+static bool getdecimal (const char **p, const char *end, unsigned long *value);
+
+static const char *skipspaces (const char *p, const char *end);
+
+// move unparsed text to the start of the buffer and read more after it
+static void filltext (Traceinfo *trace);
+
+// first newline at or after p, or end if none
+static const char *findnewline (const char *p, const char *end);
+
+// a line of type, space and digits: true if the digits are all hex, with their
+// value (truncated to 32 bits as fscanf would) in value
+static bool fastparse (const char *digits, size_t Ndigits, unsigned *value);
+
+// fscanf "%c %x" from *p, moving *p past the record
+static Parseresult scalarparse (const char **p, const char *end, bool final, Trace *record);
+
+static bool isspacechar (char c);
+
+// set up a trace to read from file, without starting its reader yet
+static void inittrace (Traceinfo *trace, FILE *file);
+
+// allocate a trace's buffer and ring and start its reader thread
+static void starttrace (Traceinfo *trace);
 
+// stop a started trace's reader thread and free its buffer and ring
+static void stoptrace (Traceinfo *trace);
+
+void settraceformat (TraceformatT format) {
+  traceformatset = format;
+}
+
+// readers start when each trace is first read (see currentchunk)
 void init_tracing (PID maxpid) {
   int i;
-  tracestate = malloc (sizeof (Traceinfo) * (maxpid+1));
-  for (i = 0; i < (maxpid+1); i++) {
-  	tracestate[i].tracefile = getfile(i);
-  	tracestate[i].record.reftype = EOFSYMBOL;
-  	tracestate[i].validity = invalid;
+  Ntraces = maxpid+1;
+  tracestate = aligned_alloc (CACHELINE, sizeof (Traceinfo) * (maxpid+1));
+  if (!tracestate)
+    error (memoryError, false, "trace state", __LINE__, __FILE__);
+  for (i = 0; i < (maxpid+1); i++)
+    inittrace (&tracestate[i], getfile(i));
+}
+
+void init_tracingfile (FILE *file) {
+  Ntraces = 1;
+  tracestate = aligned_alloc (CACHELINE, sizeof (Traceinfo));
+  if (!tracestate)
+    error (memoryError, false, "trace state", __LINE__, __FILE__);
+  inittrace (tracestate, file);
+}
+
+void start_tracing () {
+  if (!tracestate)
+    init_tracing (getmaxPID ());
+  for (PID i = 0; i < Ntraces; i++)
+    if (!tracestate[i].started && !tracestate[i].finished)
+      starttrace (&tracestate[i]);
+}
+
+static void inittrace (Traceinfo *trace, FILE *file) {
+  trace->tracefile = file;
+  trace->record.reftype = EOFSYMBOL;
+  trace->validity = invalid;
+  trace->buffer = NULL;
+  trace->start = trace->parseend = trace->length = 0;
+  trace->ateof = trace->ended = false;
+  trace->decoder = NULL;
+  trace->parseline = NULL;
+  trace->started = false;
+  for (int chunk = 0; chunk < RINGCHUNKS; chunk++)
+    trace->ring[chunk].records = NULL;
+  atomic_init (&trace->filled, 0);
+  atomic_init (&trace->emptied, 0);
+  atomic_init (&trace->stop, false);
+  trace->current = NULL;
+  trace->nextrecord = 0;
+  trace->finished = false;
+  trace->runleft = 0;
+}
+
+static void starttrace (Traceinfo *trace) {
+  trace->buffer = calloc (TEXTBUFFERSIZE + 2*TEXTPADDING, 1);
+  if (!trace->buffer)
+    error (memoryError, false, "trace text buffer", __LINE__, __FILE__);
+  for (int chunk = 0; chunk < RINGCHUNKS; chunk++)
+    if (!(trace->ring[chunk].records = malloc (sizeof (Trace) * CHUNKRECORDS)))
+      error (memoryError, false, "trace records", __LINE__, __FILE__);
+  if (pthread_create (&trace->reader, NULL, readtrace, trace))
+    error (threadError, false, "can't start trace reader thread", __LINE__, __FILE__);
+  trace->started = true;
+}
+
+static void stoptrace (Traceinfo *trace) {
+  atomic_store_explicit (&trace->stop, true, memory_order_relaxed);
+  pthread_join (trace->reader, NULL);
+  free (trace->buffer);
+  trace->buffer = NULL;
+  if (trace->decoder)
+    deconstruct_deltadecoder (&trace->decoder);
+  for (int chunk = 0; chunk < RINGCHUNKS; chunk++) {
+    free (trace->ring[chunk].records);
+    trace->ring[chunk].records = NULL;
   }
+  trace->current = NULL;
+  trace->started = false;
 }
 
 // go back to previous: if none read before, the trace state remains invald
@@ -62,18 +290,475 @@ void backtrack (PID p) {
 Trace next_addr (PID proc) {
   if (!tracestate)
     init_tracing (getmaxPID ());
-  if (tracestate[proc].validity != unused) {
-    int resultcount = fscanf(tracestate[proc].tracefile, "%c %x\n", &(tracestate[proc].record.reftype), &(tracestate[proc].record.addr));
-    if (resultcount < 2) {
-      tracestate[proc].record.reftype = EOFSYMBOL;
-    }    
+  Traceinfo *trace = &tracestate[proc];
+  if (trace->validity != unused) {
+    Tracechunk *chunk = trace->runleft ? NULL : currentchunk (trace);
+    if (trace->runleft) {
+      trace->run.addr += trace->run.stride;
+      trace->record = trace->run;
+      trace->runleft--;
+    } else if (chunk) {
+      trace->record = chunk->records[trace->nextrecord++];
+      if (trace->record.reftype == EOFSYMBOL)
+        trace->finished = true;
+      if (trace->record.count > 1) {
+        trace->run = trace->record;
+        trace->run.count = 1;
+        trace->runleft = trace->record.count - 1;
+        trace->record = trace->run;
+      }
+    } else
+      trace->record.reftype = EOFSYMBOL;
+  }
+  trace->validity = used;
+  return trace->record;
+}
+
+const Trace *next_chunk (PID proc, int *Nrecords) {
+  if (!tracestate)
+    init_tracing (getmaxPID ());
+  Traceinfo *trace = &tracestate[proc];
+  Tracechunk *chunk = currentchunk (trace);
+  if (!chunk) {
+    static const Trace eofrecord = {EOFSYMBOL, 0, 1, 0};
+    *Nrecords = 1;
+    return &eofrecord;
   }
-  tracestate[proc].validity = used;
-  return tracestate[proc].record;
+  const Trace *records = &chunk->records[trace->nextrecord];
+  *Nrecords = chunk->Nrecords - trace->nextrecord;
+  trace->nextrecord = chunk->Nrecords;
+  trace->record = records[*Nrecords-1];
+  trace->validity = used;
+  if (trace->record.reftype == EOFSYMBOL)
+    trace->finished = true;
+  return records;
 }
 
 // get rid of the local array and set its pointer MULL to be safe
 void deconstruct_tracing () {
+  for (PID i = 0; i < Ntraces; i++)
+    if (tracestate[i].started)
+      stoptrace (&tracestate[i]);
   free (tracestate);
   tracestate = NULL;
+  Ntraces = 0;
+}
+
+static void *readtrace (void *tracestate) {
+  Traceinfo *trace = tracestate;
+  size_t filled = 0;
+  filltext (trace);
+  bool delta = trace->length >= DELTAMAGICLENGTH &&
+               !memcmp (trace->buffer + TEXTPADDING, DELTAMAGIC, DELTAMAGICLENGTH);
+  if (traceformatset == deltatrace && !delta)
+    error (traceError, false, "not in the delta format", __LINE__, __FILE__);
+  if (delta && (traceformatset == autotrace || traceformatset == deltatrace)) {
+    trace->decoder = initdeltadecoder ();
+    trace->start = DELTAMAGICLENGTH;
+    trace->parseend = trace->length;
+  } else if (traceformatset == lackeytrace)
+    trace->parseline = lackeyline;
+  else if (traceformatset == memtracetrace)
+    trace->parseline = memtraceline;
+  else if (traceformatset == autotrace)
+    trace->parseline = traceformat (trace->buffer + TEXTPADDING, trace->parseend);
+  while (!trace->ended) {
+    // wait for the simulator to empty a chunk if the ring is full
+    while (filled - atomic_load_explicit (&trace->emptied, memory_order_acquire)
+           == RINGCHUNKS) {
+      if (atomic_load_explicit (&trace->stop, memory_order_relaxed))
+        return NULL;
+      sched_yield ();
+    }
+    Tracechunk *chunk = &trace->ring[filled % RINGCHUNKS];
+    chunk->Nrecords = trace->decoder   ? deltachunk (trace, chunk->records, CHUNKRECORDS)
+                    : trace->parseline ? linechunk (trace, chunk->records, CHUNKRECORDS)
+                                       : parsechunk (trace, chunk->records, CHUNKRECORDS);
+    atomic_store_explicit (&trace->filled, ++filled, memory_order_release);
+  }
+  return NULL;
+}
+
+static Tracechunk *currentchunk (Traceinfo *trace) {
+  if (trace->finished) {
+    // the records up to the end have been used: nothing more to read
+    if (trace->started)
+      stoptrace (trace);
+    return NULL;
+  }
+  if (!trace->started)
+    starttrace (trace);
+  if (trace->current && trace->nextrecord == trace->current->Nrecords) {
+    // hand the chunk back to the reader
+    atomic_store_explicit (&trace->emptied,
+                           atomic_load_explicit (&trace->emptied, memory_order_relaxed) + 1,
+                           memory_order_release);
+    trace->current = NULL;
+  }
+  if (!trace->current) {
+    size_t emptied = atomic_load_explicit (&trace->emptied, memory_order_relaxed);
+    while (atomic_load_explicit (&trace->filled, memory_order_acquire) == emptied)
+      sched_yield ();
+    trace->current = &trace->ring[emptied % RINGCHUNKS];
+    trace->nextrecord = 0;
+  }
+  return trace->current;
+}
+
+static int parsechunk (Traceinfo *trace, Trace *records, int max) {
+  int N = 0;
+  while (N < max && !trace->ended) {
+    const char *text = trace->buffer + TEXTPADDING,
+               *p = text + trace->start,
+               *end = text + trace->parseend;
+    // fscanf's "\n" skips any whitespace after a record
+    while (p < end && isspacechar (*p))
+      p++;
+    trace->start = p - text;
+    if (p == end) {
+      if (trace->ateof)
+        trace->ended = true;
+      else
+        filltext (trace);
+      continue;
+    }
+    // fast path: the whole line is "<type> <hex digits>", maybe ending "\r"
+    const char *newline = findnewline (p, end);
+    size_t linelength = newline - p;
+    if (linelength && p[linelength-1] == '\r')
+      linelength--;
+    if (linelength >= 3 && p[1] == ' ' &&
+        fastparse (p+2, linelength-2, &records[N].addr)) {
+      records[N].count = 1;
+      records[N].stride = 0;
+      records[N].size = 0;
+      records[N++].reftype = p[0];
+      trace->start = newline - text;
+      continue;
+    }
+    // the text is always whole lines unless at EOF or a line fills the buffer
+    bool final = trace->ateof ||
+                 (trace->start == 0 && trace->parseend == TEXTBUFFERSIZE);
+    switch (scalarparse (&p, end, final, &records[N])) {
+      case parsed:
+        N++;
+        trace->start = p - text;
+        break;
+      case endoftrace:
+        trace->ended = true;
+        break;
+      case needmore:
+        filltext (trace);
+        break;
+    }
+  }
+  if (trace->ended && N < max)
+    records[N++] = (Trace) {EOFSYMBOL, 0, 1, 0};
+  return N;
+}
+
+static int deltachunk (Traceinfo *trace, Trace *records, int max) {
+  int N = 0;
+  while (N < max && !trace->ended) {
+    const unsigned char *bytes = (unsigned char *) trace->buffer + TEXTPADDING + trace->start;
+    size_t available = trace->length - trace->start;
+    int used = available ? deltadecode (trace->decoder, bytes, available, &records[N]) : 0;
+    if (used > 0) {
+      N++;
+      trace->start += used;
+    } else if (used == DELTAEND)
+      trace->ended = true;
+    else if (used == DELTACORRUPT)
+      error (traceError, false, "corrupt delta trace", __LINE__, __FILE__);
+    else if (trace->ateof) // only a file cut short ends without an end record
+      error (traceError, false, "delta trace cut short", __LINE__, __FILE__);
+    else
+      filltext (trace);
+  }
+  if (trace->ended && N < max)
+    records[N++] = (Trace) {EOFSYMBOL, 0, 1, 0};
+  return N;
+}
+
+static int linechunk (Traceinfo *trace, Trace *records, int max) {
+  int N = 0;
+  while (N + MAXLINERECORDS <= max && !trace->ended) {
+    const char *text = trace->buffer + TEXTPADDING,
+               *p = text + trace->start,
+               *end = text + trace->parseend;
+    if (p == end) {
+      if (trace->ateof)
+        trace->ended = true;
+      else
+        filltext (trace);
+      continue;
+    }
+    // the text is whole lines, except at EOF or if a line fills the buffer
+    const char *newline = findnewline (p, end);
+    N += trace->parseline (p, newline, &records[N]);
+    trace->start = (newline < end ? newline + 1 : end) - text;
+  }
+  if (trace->ended)
+    records[N++] = (Trace) {EOFSYMBOL, 0, 1, 0};
+  return N;
+}
+
+static Lineparser traceformat (const char *text, size_t length) {
+  const char *end = text + length;
+  // Valgrind starts with its own messages, as ==pid== ...
+  if (length >= 2 && text[0] == '=' && text[1] == '=')
+    return lackeyline;
+  // memtrace starts with a line describing the format
+  if (length >= 7 && !memcmp (text, "Format:", 7))
+    return memtraceline;
+  // otherwise go by the first line: the usual format has no ","
+  Trace records [MAXLINERECORDS];
+  const char *newline = findnewline (text, end);
+  if (lackeyline (text, newline, records))
+    return lackeyline;
+  if (memtraceline (text, newline, records))
+    return memtraceline;
+  return NULL;
+}
+
+static int lackeyline (const char *line, const char *end, Trace *records) {
+  // exactly as Lackey prints them, which tells them from the usual format
+  if (end - line < 3 || line[2] != ' ' ||
+      !(line[0] == 'I' ? line[1] == ' ' : line[0] == ' ' && strchr ("LSM", line[1])))
+    return 0;
+  char kind = line[0] == 'I' ? 'I' : line[1];
+  const char *p = skipspaces (line+3, end);
+  unsigned long addr, size;
+  if (!gethex (&p, end, &addr) || p == end || *p++ != ',' ||
+      !getdecimal (&p, end, &size) || skipspaces (p, end) != end)
+    return 0;
+  switch (kind) {
+    case 'I':
+      records[0] = sizedrecord (FETCH, addr, size);
+      return 1;
+    case 'L':
+      records[0] = sizedrecord (READ, addr, size);
+      return 1;
+    case 'S':
+      records[0] = sizedrecord (WRITE, addr, size);
+      return 1;
+    case 'M':
+      records[0] = sizedrecord (READ, addr, size);
+      records[1] = sizedrecord (WRITE, addr, size);
+      return 2;
+  }
+  return 0;
+}
+
+static int memtraceline (const char *line, const char *end, Trace *records) {
+  const char *p = skipspaces (line, end);
+  unsigned long addr, size;
+  if (end - p < 2 || p[0] != '0' || p[1] != 'x')
+    return 0;
+  p += 2;
+  if (!gethex (&p, end, &addr) || p == end || *p++ != ':')
+    return 0;
+  p = skipspaces (p, end);
+  if (!getdecimal (&p, end, &size) || p == end || *p++ != ',')
+    return 0;
+  p = skipspaces (p, end);
+  const char *kind = p;
+  while (p < end && !isspacechar (*p))
+    p++;
+  if (p == kind)
+    return 0;
+  if (p - kind == 1 && (*kind == 'r' || *kind == 'w'))
+    records[0] = sizedrecord (*kind == 'r' ? READ : WRITE, addr, size);
+  else
+    records[0] = sizedrecord (FETCH, addr, size);
+  return 1;
+}
+
+static Trace sizedrecord (ReftypeT reftype, unsigned long addr, unsigned long size) {
+  return (Trace) {reftype, foldaddress (addr), 1, 0, (unsigned) size};
+}
+
+// murmur3's 32-bit finalizer on the high word, as a multiple of 2^FOLDKEEPBITS
+static unsigned foldaddress (unsigned long addr) {
+  unsigned high = addr >> 32;
+  if (!high)
+    return addr;
+  high ^= high >> 16;
+  high *= 0x85ebca6bu;
+  high ^= high >> 13;
+  high *= 0xc2b2ae35u;
+  high ^= high >> 16;
+  return (unsigned) addr + (high << FOLDKEEPBITS);
+}
+
+static bool gethex (const char **p, const char *end, unsigned long *value) {
+  const char *q = *p;
+  *value = 0;
+  for (; q < end && isxdigit ((unsigned char) *q); q++)
+    *value = (*value << 4) | (*q <= '9' ? *q - '0' : (*q | 0x20) - 'a' + 10);
+  bool any = q != *p;
+  *p = q;
+  return any;
+}
+
+static bool getdecimal (const char **p, const char *end, unsigned long *value) {
+  const char *q = *p;
+  *value = 0;
+  for (; q < end && *q >= '0' && *q <= '9'; q++)
+    *value = *value * 10 + (*q - '0');
+  bool any = q != *p;
+  *p = q;
+  return any;
+}
+
+static const char *skipspaces (const char *p, const char *end) {
+  while (p < end && isspacechar (*p))
+    p++;
+  return p;
+}
+
+static void filltext (Traceinfo *trace) {
+  char *text = trace->buffer + TEXTPADDING;
+  memmove (text, text + trace->start, trace->length - trace->start);
+  trace->length -= trace->start;
+  trace->start = 0;
+  size_t got = fread (text + trace->length, 1, TEXTBUFFERSIZE - trace->length,
+                      trace->tracefile);
+  trace->length += got;
+  if (!got)
+    trace->ateof = true;
+  if (trace->ateof || trace->decoder) {
+    trace->parseend = trace->length;
+  } else {
+    // stop after the last newline so no line is split
+    size_t lastline = trace->length;
+    while (lastline && text[lastline-1] != '\n')
+      lastline--;
+    // with no newline at all, wait for more unless the buffer is full
+    trace->parseend = lastline || trace->length < TEXTBUFFERSIZE ? lastline : trace->length;
+  }
+}
+
+static const char *findnewline (const char *p, const char *end) {
+#ifdef __SSE2__
+  // 16 bytes at a time; the text is padded so the last load stays in the buffer
+  const __m128i newlines = _mm_set1_epi8 ('\n');
+  for (; p < end; p += 16) {
+    unsigned mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (
+                      _mm_loadu_si128 ((const __m128i *) p), newlines));
+    if (mask) {
+      const char *newline = p + __builtin_ctz (mask);
+      return newline < end ? newline : end;
+    }
+  }
+  return end;
+#else
+  const char *newline = memchr (p, '\n', end - p);
+  return newline ? newline : end;
+#endif
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+// high bit set in each byte of x (all bytes < 128) that is > m and < n
+#define BYTESBETWEEN(x,m,n) \
+  (((ONES*(127+(n)) - ((x)&ONES*127)) & ~(x) & (((x)&ONES*127) + ONES*(127-(m)))) & HIGHS)
+
+// the 8 characters ending at last, with any before first replaced by '0'
+static uint64_t hexword (const char *first, const char *last) {
+  uint64_t word;
+  memcpy (&word, last - 7, 8);
+  if (last - first < 7) {
+    uint64_t keep = ~0ULL << (8 * (7 - (last - first)));
+    word = (word & keep) | (ONES * '0' & ~keep);
+  }
+  return word;
+}
+
+static bool allhex (uint64_t word) {
+  uint64_t low = word & ~HIGHS,
+           folded = low | ONES*0x20; // letters to lower case
+  uint64_t hex = (BYTESBETWEEN (low, '0'-1, '9'+1) |
+                  BYTESBETWEEN (folded, 'a'-1, 'f'+1)) & ~word;
+  return hex == HIGHS;
+}
+
+// 8 hex digits, first digit in the low byte, to their value
+static unsigned hexvalue (uint64_t word) {
+  // '0'-'9' are 0x30-0x39, 'a'-'f' and 'A'-'F' 0x61-0x66 and 0x41-0x46
+  word = (word & ONES*0x0f) + 9*((word >> 6) & ONES);
+  // pack pairs of nibbles into bytes, then pairs of bytes, then 16-bit halves
+  word = ((word << 4) & 0x00f000f000f000f0ULL) | ((word >> 8) & 0x000f000f000f000fULL);
+  word = ((word << 8) & 0x0000ff000000ff00ULL) | ((word >> 16) & 0x000000ff000000ffULL);
+  return (unsigned) (((word & 0xffff) << 16) | ((word >> 32) & 0xffff));
+}
+
+static bool fastparse (const char *digits, size_t Ndigits, unsigned *value) {
+  if (Ndigits > 16) // might overflow: leave it to the scalar parser
+    return false;
+  const char *last = digits + Ndigits - 1;
+  uint64_t lowdigits = hexword (Ndigits > 8 ? last - 7 : digits, last);
+  if (!allhex (lowdigits))
+    return false;
+  // digits above the low 8 only need checking: fscanf into unsigned keeps the low 32 bits
+  if (Ndigits > 8 && !allhex (hexword (digits, last - 8)))
+    return false;
+  *value = hexvalue (lowdigits);
+  return true;
+}
+
+#else
+
+static bool fastparse (const char *digits, size_t Ndigits, unsigned *value) {
+  return false;
+}
+
+#endif
+
+static Parseresult scalarparse (const char **p, const char *end, bool final, Trace *record) {
+  const char *q = *p;
+  record->reftype = *q++;
+  while (q < end && isspacechar (*q))
+    q++;
+  bool negative = false;
+  if (q < end && (*q == '+' || *q == '-'))
+    negative = *q++ == '-';
+  if (q+2 < end && q[0] == '0' && (q[1] | 0x20) == 'x' && isxdigit ((unsigned char) q[2]))
+    q += 2;
+  unsigned long value = 0;
+  bool overflow = false;
+  const char *digits = q;
+  for (; q < end && isxdigit ((unsigned char) *q); q++) {
+    if (value >> (8*sizeof (value) - 4))
+      overflow = true;
+    value = (value << 4) | (*q <= '9' ? *q - '0' : (*q | 0x20) - 'a' + 10);
+  }
+  if (q == end && !final)
+    return needmore;  // the record may go on into text not read yet
+  if (q == digits)
+    return endoftrace; // as when fscanf fails to read the address
+  if (overflow)
+    value = ~0UL;     // as strtoul, which fscanf uses
+  record->addr = negative ? -value : value;
+  record->count = 1;
+  record->stride = 0;
+  record->size = 0;
+  // an access size, not in fscanf's format
+  if (q+1 < end && *q == ',' && isdigit ((unsigned char) q[1])) {
+    unsigned long size = 0;
+    for (q++; q < end && isdigit ((unsigned char) *q); q++)
+      size = size * 10 + (*q - '0');
+    if (q == end && !final)
+      return needmore;
+    record->size = size;
+  }
+  *p = q;
+  return parsed;
+}
+
+static bool isspacechar (char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
 }
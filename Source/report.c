@@ -0,0 +1,240 @@
+/*
+ * report.c
+ *
+ * Machine-readable results (see report.h). JSON is written as values arrive,
+ * so only the unit and reftype open at the moment need remembering: a change
+ * of either closes the object it was in.
+ *
+ */
+
+#include "report.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+#define MAXNAME 32
+
+typedef enum {nosection, configsection, workloadsection} SectionT;
+
+struct Report {
+    ReportformatT format;
+    FILE *output;
+    SectionT section;
+    bool started,            // CSV: header written
+         sweeping;           // a sweep's points are being reported
+    int point;
+    PID workload;
+    unsigned long references; // part way through the workload; 0 at its end
+    char unit [MAXNAME],     // JSON: the objects open, "" if none
+         reftype [MAXNAME];
+    bool first;              // JSON: nothing yet in the innermost object open
+}; // typedef ReportT
+
+
+//////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
+
+// start a value: CSV its row up to the value, JSON its name after opening or
+// closing objects for its unit and reftype
+static void startvalue (ReportT *report, const char *unit, const char *reftype,
+                        const char *name);
+
+// JSON: close objects down to the workload or configuration object
+static void closeunit (ReportT *report);
+
+// JSON: close the configuration object or workloads array
+static void closesection (ReportT *report);
+
+// JSON: the separator before the next member of the innermost object
+static void nextmember (ReportT *report);
+
+// a string as JSON or CSV needs it: quoted, with quotes (and for JSON
+// backslashes and control characters) escaped
+static void putstring (ReportT *report, const char *string);
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+ReportT *initreport (ReportformatT format, FILE *output) {
+    if (format == textformat)
+        return NULL;
+    ReportT *report = calloc (1, sizeof (ReportT));
+    report->format = format;
+    report->output = output;
+    report->section = nosection;
+    if (format == jsonformat)
+        fprintf (output, "{");
+    return report;
+}
+
+void reportsweep (ReportT *report, int point) {
+    if (report->format == jsonformat) {
+        closesection (report);
+        fprintf (report->output, report->sweeping ? "},\n{" : "\n\"sweep\": [\n{");
+        fprintf (report->output, "\"point\": %d,", point);
+    }
+    report->section = nosection;
+    report->sweeping = true;
+    report->point = point;
+}
+
+void reportconfiguration (ReportT *report) {
+    report->section = configsection;
+    if (report->format == jsonformat) {
+        fprintf (report->output, "\n\"configuration\": {");
+        report->first = true;
+    }
+}
+
+void reportworkload (ReportT *report, PID workload) {
+    reportinterval (report, workload, 0);
+}
+
+void reportinterval (ReportT *report, PID workload, unsigned long references) {
+    if (report->format == jsonformat) {
+        closeunit (report);
+        if (report->section == configsection)
+            fprintf (report->output, "},\n\"workloads\": [\n{");
+        else if (report->section == workloadsection)
+            fprintf (report->output, "},\n{");
+        else
+            fprintf (report->output, "\n\"workloads\": [\n{");
+        fprintf (report->output, "\"workload\": %lu", workload);
+        if (references)
+            fprintf (report->output, ", \"references\": %lu", references);
+        report->first = false;
+    }
+    report->section = workloadsection;
+    report->workload = workload;
+    report->references = references;
+}
+
+void reportcount (ReportT *report, const char *unit, const char *reftype,
+                  const char *name, ELAPSED value) {
+    startvalue (report, unit, reftype, name);
+    fprintf (report->output, "%lu", value);
+    if (report->format == csvformat)
+        fprintf (report->output, "\n");
+}
+
+void reportratio (ReportT *report, const char *unit, const char *reftype,
+                  const char *name, double value) {
+    startvalue (report, unit, reftype, name);
+    fprintf (report->output, "%.6g", value);
+    if (report->format == csvformat)
+        fprintf (report->output, "\n");
+}
+
+void reportstring (ReportT *report, const char *unit, const char *reftype,
+                   const char *name, const char *value) {
+    startvalue (report, unit, reftype, name);
+    putstring (report, value);
+    if (report->format == csvformat)
+        fprintf (report->output, "\n");
+}
+
+void finishreport (ReportT **report) {
+    if ((*report)->format == jsonformat) {
+        closesection (*report);
+        if ((*report)->sweeping)
+            fprintf ((*report)->output, "}\n]");
+        fprintf ((*report)->output, "\n}\n");
+    }
+    fflush ((*report)->output);
+    free (*report);
+    *report = NULL;
+}
+
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+static void startvalue (ReportT *report, const char *unit, const char *reftype,
+                        const char *name) {
+    if (report->format == csvformat) {
+        // the header waits for the first value, to know if there is a sweep
+        if (!report->started)
+            fprintf (report->output, "%sworkload,unit,reftype,name,value\n",
+                     report->sweeping ? "point," : "");
+        report->started = true;
+        if (report->sweeping)
+            fprintf (report->output, "%d,", report->point);
+        if (report->section == configsection)
+            fprintf (report->output, "config,");
+        else if (report->references)
+            fprintf (report->output, "%lu@%lu,", report->workload, report->references);
+        else
+            fprintf (report->output, "%lu,", report->workload);
+        putstring (report, unit);
+        fprintf (report->output, ",%s,", reftype);
+        putstring (report, name);
+        fprintf (report->output, ",");
+        return;
+    }
+    if (strcmp (unit, report->unit)) {
+        closeunit (report);
+        nextmember (report);
+        putstring (report, unit);
+        fprintf (report->output, ": {");
+        strncpy (report->unit, unit, MAXNAME-1);
+        report->first = true;
+    }
+    if (strcmp (reftype, report->reftype)) {
+        if (*report->reftype) {
+            fprintf (report->output, "}");
+            report->first = false;
+        }
+        *report->reftype = '\0';
+        if (*reftype) {
+            nextmember (report);
+            fprintf (report->output, "\"%s\": {", reftype);
+            strncpy (report->reftype, reftype, MAXNAME-1);
+            report->first = true;
+        }
+    }
+    nextmember (report);
+    putstring (report, name);
+    fprintf (report->output, ": ");
+}
+
+static void closeunit (ReportT *report) {
+    if (*report->reftype)
+        fprintf (report->output, "}");
+    if (*report->unit)
+        fprintf (report->output, "}");
+    if (*report->unit)
+        report->first = false;
+    *report->unit = *report->reftype = '\0';
+}
+
+static void closesection (ReportT *report) {
+    closeunit (report);
+    if (report->section == workloadsection)
+        fprintf (report->output, "}\n]");
+    else if (report->section == configsection)
+        fprintf (report->output, "}");
+    report->section = nosection;
+}
+
+static void nextmember (ReportT *report) {
+    if (!report->first)
+        fprintf (report->output, ", ");
+    report->first = false;
+}
+
+static void putstring (ReportT *report, const char *string) {
+    fputc ('"', report->output);
+    for (; *string; string++)
+        if (*string == '"')
+            fputs (report->format == jsonformat ? "\\\"" : "\"\"", report->output);
+        else if (report->format == jsonformat && *string == '\\')
+            fputs ("\\\\", report->output);
+        else if (report->format == jsonformat && (unsigned char) *string < ' ')
+            fprintf (report->output, "\\u%04x", *string);
+        else
+            fputc (*string, report->output);
+    fputc ('"', report->output);
+}
@@ -0,0 +1,83 @@
+/*
+ * rng.c
+ *
+ * Random number generators for replacement: xoshiro128** (Blackman and
+ * Vigna), 16 bytes of state and a few shifts and multiplies a number, seeded
+ * with splitmix64 from the seed and stream so streams are unrelated.
+ *
+ */
+
+#include "rng.h"
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+struct Random {
+    uint32_t state [4]; // never all zero
+}; // typedef RandomT
+
+
+//////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
+
+// the next number in a splitmix64 sequence, advancing *x
+static uint64_t splitmix64 (uint64_t *x);
+
+static uint32_t rotl (uint32_t x, int k);
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+size_t randombytes () {
+    return arenabytes (sizeof (RandomT));
+}
+
+RandomT *initrandom (uint64_t seed, unsigned stream, ArenaT *arena) {
+    RandomT *rng = arenaalloc (arena, sizeof (RandomT));
+    reseedrandom (rng, seed, stream);
+    return rng;
+}
+
+void reseedrandom (RandomT *rng, uint64_t seed, unsigned stream) {
+    // streams start far apart in splitmix64's sequence (2^32 steps)
+    uint64_t x = seed + ((uint64_t) stream << 32) * 0x9e3779b97f4a7c15ull;
+    uint64_t first = splitmix64 (&x), second = splitmix64 (&x);
+    rng->state[0] = first;
+    rng->state[1] = first >> 32;
+    rng->state[2] = second;
+    rng->state[3] = second >> 32;
+    if (!(rng->state[0] | rng->state[1] | rng->state[2] | rng->state[3]))
+        rng->state[0] = 1;
+}
+
+uint32_t nextrandom (RandomT *rng) {
+    uint32_t *s = rng->state,
+             result = rotl (s[1] * 5, 7) * 9,
+             t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl (s[3], 11);
+    return result;
+}
+
+// multiply and keep the high half (Lemire): the bias is at most below/2^32
+unsigned randombelow (RandomT *rng, unsigned below) {
+    return ((uint64_t) nextrandom (rng) * below) >> 32;
+}
+
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+static uint64_t splitmix64 (uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static uint32_t rotl (uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
@@ -0,0 +1,313 @@
+/*
+ * serve.c
+ *
+ * Server mode (see serve.h): one thread polls the listening socket, the
+ * connected clients and, between polls, the shared-memory rings clients have
+ * attached, feeding everything to a single simulator from libcachesim.
+ *
+ */
+
+#include "serve.h"
+#include "libcachesim.h"
+#include "readfile.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h> // NAME_MAX
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+#define MAXCLIENTS  64
+#define MAXLEVELS   16   // most levels reported in a stats reply
+#define FEEDBATCH   4096 // records converted and fed at a time
+#define RINGPOLLMS  1    // how long to wait on sockets when rings may fill up
+
+typedef struct {
+    int socket;
+    char *buffer;        // a message being received: header then payload
+    size_t received;
+    ServeRingT *ring;    // NULL if the client has not attached one
+    size_t ringbytes;
+    uint32_t capacity;   // the ring's, as checked when attached: the client can
+                         // write the one in the ring at any time
+} ClientT;
+
+static volatile sig_atomic_t stopping = false;
+
+
+//////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
+
+static void stop (int signal);
+
+static int listenon (char *socketpath);
+
+// read what a client has sent and act on each complete message; false if the
+// client has gone or sent something invalid
+static bool receive (SimulatorT *simulator, ClientT *clients, int Nclients, ClientT *client);
+
+static bool respond (SimulatorT *simulator, ClientT *clients, int Nclients, ClientT *client,
+                     ServeHeaderT *header, char *payload);
+
+// simulate records up to the first that is not I, R, W or X; false if there
+// is one, and the rest are dropped
+static bool feed (SimulatorT *simulator, const ServeRecordT *records, size_t Nrecords);
+
+// a type of record a client may send
+static bool servable (char reftype);
+
+// feed everything waiting in the rings, detaching any that holds a record
+// that can't be fed
+static void drainrings (SimulatorT *simulator, ClientT *clients, int Nclients);
+
+static bool attachring (ClientT *client, char *name, size_t namelength);
+
+static void dropclient (ClientT *client);
+
+static bool sendall (int socket, const void *data, size_t length);
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+int serve (char *socketpath, char *configfile) {
+    long length;
+    char *config = read_file (configfile, &length, true, NULL, 0);
+    if (!config)
+        error (configFileError, false, configfile, __LINE__, __FILE__);
+    SimulatorT *simulator = initsimulator (config);
+    free (config);
+    if (!simulator)
+        error (configError, false, configfile, __LINE__, __FILE__);
+    int listener = listenon (socketpath);
+    struct sigaction action = {0};
+    action.sa_handler = stop; // no SA_RESTART: interrupts poll
+    sigaction (SIGINT, &action, NULL);
+    sigaction (SIGTERM, &action, NULL);
+    signal (SIGPIPE, SIG_IGN); // a client gone while replying is dropped, not fatal
+    printf ("serving on %s\n", socketpath);
+    fflush (stdout);
+
+    ClientT clients [MAXCLIENTS];
+    int Nclients = 0;
+    struct pollfd polled [MAXCLIENTS+1];
+    while (!stopping) {
+        bool anyring = false;
+        polled[0] = (struct pollfd) {listener, POLLIN, 0};
+        for (int i = 0; i < Nclients; i++) {
+            polled[i+1] = (struct pollfd) {clients[i].socket, POLLIN, 0};
+            anyring = anyring || clients[i].ring;
+        }
+        int ready = poll (polled, Nclients+1, anyring?RINGPOLLMS:-1);
+        if (ready < 0 && errno != EINTR)
+            error (serveError, false, "poll", __LINE__, __FILE__);
+        drainrings (simulator, clients, Nclients);
+        if (ready <= 0)
+            continue;
+        // clients first, as accepting one changes the array polled
+        for (int i = Nclients-1; i >= 0; i--)
+            if (polled[i+1].revents &&
+                !receive (simulator, clients, Nclients, &clients[i])) {
+                dropclient (&clients[i]);
+                clients[i] = clients[--Nclients];
+            }
+        if (polled[0].revents & POLLIN) {
+            int socket = accept (listener, NULL, NULL);
+            if (socket >= 0 && Nclients == MAXCLIENTS)
+                close (socket);
+            else if (socket >= 0)
+                clients[Nclients++] = (ClientT) {socket, malloc (sizeof (ServeHeaderT) +
+                                                 MAXSERVEPAYLOAD), 0, NULL, 0, 0};
+        }
+    }
+    drainrings (simulator, clients, Nclients);
+    for (int i = 0; i < Nclients; i++)
+        dropclient (&clients[i]);
+    close (listener);
+    unlink (socketpath);
+    reportsimulator (simulator);
+    deconstruct_simulator (&simulator);
+    return 0;
+}
+
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+static void stop (int signal) {
+    stopping = true;
+}
+
+static int listenon (char *socketpath) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen (socketpath) >= sizeof (address.sun_path))
+        error (serveError, false, "socket path too long", __LINE__, __FILE__);
+    strcpy (address.sun_path, socketpath);
+    int listener = socket (AF_UNIX, SOCK_STREAM, 0);
+    unlink (socketpath); // left over from a server that didn't stop cleanly
+    if (listener < 0 ||
+        bind (listener, (struct sockaddr *) &address, sizeof (address)) ||
+        listen (listener, MAXCLIENTS))
+        error (serveError, false, socketpath, __LINE__, __FILE__);
+    return listener;
+}
+
+static bool receive (SimulatorT *simulator, ClientT *clients, int Nclients, ClientT *client) {
+    size_t room = sizeof (ServeHeaderT) + MAXSERVEPAYLOAD - client->received;
+    ssize_t got = recv (client->socket, client->buffer + client->received, room, 0);
+    if (got <= 0)
+        return got < 0 && (errno == EINTR || errno == EAGAIN);
+    client->received += got;
+    // act on every complete message, keeping the start of any incomplete one
+    size_t used = 0;
+    while (client->received - used >= sizeof (ServeHeaderT)) {
+        ServeHeaderT header;
+        memcpy (&header, client->buffer + used, sizeof (ServeHeaderT));
+        if (header.length > MAXSERVEPAYLOAD)
+            return false;
+        if (client->received - used < sizeof (ServeHeaderT) + header.length)
+            break;
+        if (!respond (simulator, clients, Nclients, client, &header,
+                      client->buffer + used + sizeof (ServeHeaderT)))
+            return false;
+        used += sizeof (ServeHeaderT) + header.length;
+    }
+    memmove (client->buffer, client->buffer + used, client->received - used);
+    client->received -= used;
+    return true;
+}
+
+static bool respond (SimulatorT *simulator, ClientT *clients, int Nclients, ClientT *client,
+                     ServeHeaderT *header, char *payload) {
+    switch (header->type) {
+    case SERVEFEED: {
+        if (feed (simulator, (ServeRecordT *) payload, header->length / sizeof (ServeRecordT)))
+            return true;
+        ServeHeaderT reply = {SERVEERROR, 0};
+        return sendall (client->socket, &reply, sizeof (reply));
+    }
+    case SERVESTATS: {
+        // everything sent before the query counts, including what is in rings
+        drainrings (simulator, clients, Nclients);
+        LevelstatsT levels [MAXLEVELS];
+        int N = snapshotsimulator (simulator, levels, MAXLEVELS);
+        ServeHeaderT reply = {SERVESTATS, N * sizeof (LevelstatsT)};
+        return sendall (client->socket, &reply, sizeof (reply)) &&
+               sendall (client->socket, levels, reply.length);
+    }
+    case SERVERING: {
+        ServeHeaderT reply = {attachring (client, payload, header->length) ?
+                              SERVERING : SERVEERROR, 0};
+        return sendall (client->socket, &reply, sizeof (reply));
+    }
+    case SERVEQUIT:
+        stopping = true;
+        return true;
+    }
+    return false;
+}
+
+static bool feed (SimulatorT *simulator, const ServeRecordT *records, size_t Nrecords) {
+    Trace batch [FEEDBATCH];
+    while (Nrecords) {
+        int N = Nrecords < FEEDBATCH ? Nrecords : FEEDBATCH, valid = 0;
+        while (valid < N && servable (records[valid].reftype)) {
+            batch[valid] = (Trace) {records[valid].reftype, records[valid].addr, 1, 0};
+            valid++;
+        }
+        if (feedsimulator (simulator, batch, valid) < valid || valid < N)
+            return false;
+        records += N;
+        Nrecords -= N;
+    }
+    return true;
+}
+
+static bool servable (char reftype) {
+    return reftype == FETCH || reftype == READ || reftype == WRITE || reftype == EXCEPTION;
+}
+
+static void drainrings (SimulatorT *simulator, ClientT *clients, int Nclients) {
+    for (int i = 0; i < Nclients; i++) {
+        ServeRingT *ring = clients[i].ring;
+        if (!ring)
+            continue;
+        uint64_t head = atomic_load_explicit (&ring->head, memory_order_acquire),
+                 tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+        uint32_t capacity = clients[i].capacity;
+        bool broken = head - tail > capacity; // the client broke the ring: detach it
+        while (!broken && tail != head) {
+            // as far as the end of the array at a time
+            uint64_t start = tail % capacity,
+                     N = head - tail < capacity - start ? head - tail : capacity - start;
+            broken = !feed (simulator, &ring->records[start], N);
+            tail += N;
+        }
+        if (broken) {
+            munmap (ring, clients[i].ringbytes);
+            clients[i].ring = NULL;
+            continue;
+        }
+        atomic_store_explicit (&ring->tail, tail, memory_order_release);
+    }
+}
+
+static bool attachring (ClientT *client, char *name, size_t namelength) {
+    char ringname [NAME_MAX+1];
+    if (client->ring || !namelength || namelength > NAME_MAX)
+        return false;
+    memcpy (ringname, name, namelength);
+    ringname[namelength] = '\0';
+    int fd = shm_open (ringname, O_RDWR, 0);
+    if (fd < 0)
+        return false;
+    struct stat status;
+    ServeRingT *ring = MAP_FAILED;
+    if (!fstat (fd, &status) && status.st_size >= sizeof (ServeRingT))
+        ring = mmap (NULL, status.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (ring == MAP_FAILED)
+        return false;
+    uint32_t capacity = ring->capacity;
+    if (!capacity || (capacity & (capacity-1)) ||
+        sizeof (ServeRingT) + (size_t) capacity * sizeof (ServeRecordT) > status.st_size) {
+        munmap (ring, status.st_size);
+        return false;
+    }
+    client->ring = ring;
+    client->ringbytes = status.st_size;
+    client->capacity = capacity;
+    return true;
+}
+
+static void dropclient (ClientT *client) {
+    if (client->ring)
+        munmap (client->ring, client->ringbytes);
+    close (client->socket);
+    free (client->buffer);
+}
+
+static bool sendall (int socket, const void *data, size_t length) {
+    const char *bytes = data;
+    while (length) {
+        ssize_t sent = send (socket, bytes, length, 0);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        length -= sent;
+    }
+    return true;
+}
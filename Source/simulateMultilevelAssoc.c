@@ -3,48 +3,340 @@
  * 
  * Trace-driven N-way multilevel associative cache simulation, with stats.
  * Configuration is passed in and used to set up the simulated cache.
- * Resets stats after each trace file; would need a scheduler and other OS machinery
- * to simulate a real multitasking workload
+ * The hierarchy is built once: between trace files it is reset to as new, or only
+ * flushed, or only has its stats reset (see BetweentracesT).
+ * Warm-up, interval stats and sampling (see RunoptionsT) split the chunks of a
+ * trace where they need something done, splitting runs if need be; without
+ * them each chunk is simulated whole.
+ * If scheduled (see SchedulingT), each trace is a process with its place in its
+ * chunk kept while others run; a slice ends at the end of a quantum, splitting
+ * a run if need be, or at an exception. There is no other OS machinery: no
+ * scheduling cost, and no separate address spaces beyond the TLBs being emptied.
  *
  * Philip Machanick
  * June 2018
  *
  */
 
-#include <stdlib.h> // random and malloc
+#include <stdlib.h> // malloc
 #include <stdio.h>
+#include <limits.h> // ULONG_MAX
 
 #include "simulateMultilevelAssoc.h"
 #include "workload.h"
 #include "error.h"
 #include "multilevelAssoc.h"
- 
-void simulateMultilevelAssoc (CacheSetupT* paremeters[]) {
-  Trace tracerecord;
+
+// a trace being simulated, for doing what the run options need as it goes
+typedef struct {
+  CacheT **cache;
+  RunoptionsT *options;
+  ReportT *report;
+  PID pid;
+  unsigned long done; // references simulated or skipped so far
+} TracerunT;
+
+// a trace run as a process by the scheduler
+typedef struct {
+  const Trace *records; // the rest of the chunk it has got to
+  int Nrecords;
+  Trace rest;           // the rest of a run split by the end of a quantum:
+                        // count 0 if none
+  unsigned long readyat;// time it may run again after an exception
+  bool finished;
+  unsigned long references, slices, waits;
+} ProcessT;
+
+// simulate a chunk of records, split where the options need something done;
+// false at the end of the trace
+static bool runchunk (TracerunT *run, const Trace *records, int Nrecords);
+
+// simulate records that go no further than the next boundary, or skip them if
+// outside the sample; false at the end of the trace
+static bool runspan (TracerunT *run, const Trace *records, int Nrecords);
+
+// references from the start of the trace to the next point where the options
+// need something done (end of warm-up, interval or sample window); ULONG_MAX if none
+static unsigned long nextboundary (TracerunT *run);
+
+// do what the options need where the trace has got to
+static void atboundary (TracerunT *run);
+
+static unsigned long references (const Trace *record);
+
+// run every trace interleaved as a process, then report the stats
+static void runscheduled (CacheT **cache, RunoptionsT *options, ReportT *report,
+                          PID maxPID);
+
+// run a process for a slice, from time clock; the references it ran
+static unsigned long runslice (CacheT **cache, RunoptionsT *options, PID pid,
+                               ProcessT *process, unsigned long clock);
+
+// the next process after running that may run at time clock, running itself
+// last; maxPID+1 if none
+static PID nextready (ProcessT *processes, PID maxPID, PID running,
+                      unsigned long clock);
+
+static void reportscheduled (CacheT **cache, RunoptionsT *options, ReportT *report,
+                             ProcessT *processes, PID maxPID,
+                             unsigned long switches, unsigned long idle);
+
+void simulateMultilevelAssoc (CacheSetupT* paremeters[], RunoptionsT *options,
+                              ReportT *report) {
   PID pid, maxPID = getmaxPID ();
   
-  srandom (1); // for repeatability: this is the default initialization of random
+  if (getSetupFilterout (paremeters[0]) && maxPID > 0)
+     error (workloadError, false, "L1 filtering takes a workload of one trace",
+            __LINE__, __FILE__);
+  if (options->attribute && maxPID >= MAXOWNERS)
+     error (workloadError, false, "too many traces to attribute blocks to",
+            __LINE__, __FILE__);
+  CacheT** cache = initmultilevelcache (paremeters, options->attribute ? maxPID+1 : 0);
+  int Nlevels = countlevels (cache);
+  if (options->attribute)
+     sampleowners (cache, options->occupancy);
+  if (options->schedule != noschedule) {
+     start_tracing ();
+     runscheduled (cache, options, report, maxPID);
+     deconstruct_multilevelcache (cache);
+     deconstruct_tracing ();
+     return;
+  }
   for (pid = 0; pid <= maxPID; pid++) {
-     CacheT** cache = initmultilevelcache (paremeters);
-     int Nlevels = countlevels (cache);
-     printf ("workoad [%lu], %d levels\n", pid, Nlevels);
-     while (true) {
-         tracerecord = next_addr (pid);
-         if (tracerecord.reftype == EXCEPTION)
-             continue; // skip these
-         if (tracerecord.reftype != READ &&
-             tracerecord.reftype != WRITE &&
-             tracerecord.reftype != FETCH) {
-             // done with this cache -- deallocate it 
-             break; // switch to next PID
-             }  // next trace record
-             
-             // cacheHit (CacheT* thecache[], AddressT where, ReftypeT reftype
-             handleReference (cache, tracerecord.addr, tracerecord.reftype);
+     if (pid > 0 && options->between == resetbetween)
+         resetmultilevelcache (cache);
+     else if (pid > 0 && options->between == flushbetween)
+         flushmultilevelcache (cache);
+     else if (pid > 0)
+         resetmultilevelstats (cache);
+     if (options->attribute)
+         setowner (cache, pid);
+     if (!report)
+         printf ("workoad [%lu], %d levels\n", pid, Nlevels);
+     // a chunk at a time: the trace is read and decoded in the background
+     TracerunT run = {cache, options, report, pid, 0};
+     bool more = true;
+     while (more) {
+         int Nrecords;
+         const Trace *records = next_chunk (pid, &Nrecords);
+         more = runchunk (&run, records, Nrecords); // else switch to next PID
     }
-    reportstats (cache);
-    deconstruct_multilevelcache (cache);
+    if (report) {
+        reportworkload (report, pid);
+        reportstatsto (cache, report);
+    } else
+        reportstats (cache);
   }
+  deconstruct_multilevelcache (cache);
   deconstruct_tracing ();
 }
 
+static bool runchunk (TracerunT *run, const Trace *records, int Nrecords) {
+  while (Nrecords) {
+    unsigned long boundary = nextboundary (run);
+    if (boundary == ULONG_MAX) // the usual case: nothing to split
+      return runspan (run, records, Nrecords);
+    // whole records up to the boundary go together
+    unsigned long left = boundary - run->done, refs = 0;
+    int N = 0;
+    while (N < Nrecords && refs + references (&records[N]) <= left)
+      refs += references (&records[N++]);
+    if (N) {
+      if (!runspan (run, records, N))
+        return false;
+      run->done += refs;
+      records += N;
+      Nrecords -= N;
+      if (run->done == boundary)
+        atboundary (run);
+      continue;
+    }
+    // a run across the boundary: split it there, and at any boundaries after
+    Trace rest = *records++;
+    Nrecords--;
+    while (rest.count) {
+      Trace piece = rest;
+      piece.count = left < rest.count ? left : rest.count;
+      runspan (run, &piece, 1);
+      run->done += piece.count;
+      rest.addr += piece.count * rest.stride;
+      rest.count -= piece.count;
+      if (run->done == boundary) {
+        atboundary (run);
+        boundary = nextboundary (run);
+      }
+      left = boundary - run->done;
+    }
+  }
+  return true;
+}
+
+static bool runspan (TracerunT *run, const Trace *records, int Nrecords) {
+  RunoptionsT *options = run->options;
+  if (options->sample > 1 && run->done >= options->warmup &&
+      (run->done - options->warmup) / SAMPLEWINDOW % options->sample) {
+    for (int i = 0; i < Nrecords; i++)
+      if (records[i].reftype == EOFSYMBOL)
+        return false;
+    return true;
+  }
+  return handleRecords (run->cache, records, Nrecords) == Nrecords;
+}
+
+static unsigned long nextboundary (TracerunT *run) {
+  RunoptionsT *options = run->options;
+  if (run->done < options->warmup)
+    return options->warmup;
+  unsigned long after = run->done - options->warmup, next = ULONG_MAX;
+  if (options->interval)
+    next = options->warmup + (after / options->interval + 1) * options->interval;
+  if (options->sample > 1) {
+    unsigned long window = options->warmup + (after / SAMPLEWINDOW + 1) * SAMPLEWINDOW;
+    if (window < next)
+      next = window;
+  }
+  return next;
+}
+
+static void atboundary (TracerunT *run) {
+  RunoptionsT *options = run->options;
+  if (options->warmup && run->done == options->warmup)
+    resetmultilevelstats (run->cache);
+  else if (options->interval && run->done > options->warmup &&
+           (run->done - options->warmup) % options->interval == 0) {
+    if (run->report) {
+      reportinterval (run->report, run->pid, run->done);
+      reportstatsto (run->cache, run->report);
+    } else {
+      printf ("workload [%lu] after %lu references\n", run->pid, run->done);
+      reportstats (run->cache);
+    }
+  }
+}
+
+static unsigned long references (const Trace *record) {
+  return record->reftype == EXCEPTION || record->reftype == EOFSYMBOL ? 0 : record->count;
+}
+
+static void runscheduled (CacheT **cache, RunoptionsT *options, ReportT *report,
+                          PID maxPID) {
+  ProcessT *processes = calloc (maxPID+1, sizeof (ProcessT));
+  if (!processes)
+    error (memoryError, false, "process table", __LINE__, __FILE__);
+  unsigned long clock = 0, switches = 0, idle = 0;
+  PID running = maxPID, unfinished = maxPID+1; // so PID 0 runs first
+  bool started = false;
+  while (unfinished) {
+    PID pid = nextready (processes, maxPID, running, clock);
+    if (pid > maxPID) { // all waiting: idle until the first is ready
+      unsigned long first = ULONG_MAX;
+      for (PID i = 0; i <= maxPID; i++)
+        if (!processes[i].finished && processes[i].readyat < first)
+          first = processes[i].readyat;
+      idle += first - clock;
+      clock = first;
+      continue;
+    }
+    if (started && pid != running) {
+      contextswitch (cache);
+      switches++;
+    }
+    if (options->attribute)
+      setowner (cache, pid);
+    started = true;
+    running = pid;
+    clock += runslice (cache, options, pid, &processes[pid], clock);
+    if (processes[pid].finished)
+      unfinished--;
+  }
+  reportscheduled (cache, options, report, processes, maxPID, switches, idle);
+  free (processes);
+}
+
+static unsigned long runslice (CacheT **cache, RunoptionsT *options, PID pid,
+                               ProcessT *process, unsigned long clock) {
+  unsigned long quantum = options->quantum ? options->quantum : ULONG_MAX, done = 0;
+  process->slices++;
+  while (done < quantum) {
+    if (process->rest.count) {
+      Trace piece = process->rest;
+      if (piece.count > quantum - done)
+        piece.count = quantum - done;
+      handleRecords (cache, &piece, 1);
+      done += piece.count;
+      process->rest.addr += piece.count * piece.stride;
+      process->rest.count -= piece.count;
+      continue;
+    }
+    if (!process->Nrecords)
+      process->records = next_chunk (pid, &process->Nrecords);
+    // whole records up to the end of the quantum or the end of the slice
+    const Trace *records = process->records;
+    unsigned long refs = 0;
+    int N = 0;
+    while (N < process->Nrecords && records[N].reftype != EOFSYMBOL &&
+           !(records[N].reftype == EXCEPTION && options->schedule == switchonexception) &&
+           refs + references (&records[N]) <= quantum - done)
+      refs += references (&records[N++]);
+    handleRecords (cache, records, N);
+    done += refs;
+    process->records += N;
+    process->Nrecords -= N;
+    if (!process->Nrecords)
+      continue;
+    // the record that stopped it
+    Trace record = *process->records++;
+    process->Nrecords--;
+    if (record.reftype == EOFSYMBOL) {
+      process->finished = true;
+      break;
+    }
+    if (record.reftype == EXCEPTION) {
+      process->waits++;
+      process->readyat = clock + done + record.addr;
+      break;
+    }
+    process->rest = record; // a run across the end of the quantum
+  }
+  process->references += done;
+  return done;
+}
+
+static PID nextready (ProcessT *processes, PID maxPID, PID running,
+                      unsigned long clock) {
+  for (PID i = 1; i <= maxPID+1; i++) {
+    PID pid = (running + i) % (maxPID+1);
+    if (!processes[pid].finished && processes[pid].readyat <= clock)
+      return pid;
+  }
+  return maxPID+1;
+}
+
+static void reportscheduled (CacheT **cache, RunoptionsT *options, ReportT *report,
+                             ProcessT *processes, PID maxPID,
+                             unsigned long switches, unsigned long idle) {
+  static const char *policies [] = {"none", "roundrobin", "exception"};
+  if (!report) {
+    printf ("workload [0..%lu] interleaved, %s quantum %lu, %d levels\n", maxPID,
+            policies[options->schedule], options->quantum, countlevels (cache));
+    reportstats (cache);
+    for (PID pid = 0; pid <= maxPID; pid++)
+      printf ("process [%lu] %lu references in %lu slices, %lu waits\n", pid,
+              processes[pid].references, processes[pid].slices, processes[pid].waits);
+    printf ("%lu context switches, %lu references idle\n", switches, idle);
+    return;
+  }
+  reportworkload (report, 0);
+  reportstatsto (cache, report);
+  for (PID pid = 0; pid <= maxPID; pid++) {
+    char unit [32];
+    snprintf (unit, sizeof (unit), "process%lu", pid);
+    reportcount (report, unit, "", "references", processes[pid].references);
+    reportcount (report, unit, "", "slices", processes[pid].slices);
+    reportcount (report, unit, "", "waits", processes[pid].waits);
+  }
+  reportstring (report, "scheduler", "", "policy", policies[options->schedule]);
+  reportcount (report, "scheduler", "", "quantum", options->quantum);
+  reportcount (report, "scheduler", "", "switches", switches);
+  reportcount (report, "scheduler", "", "idle", idle);
+}
@@ -36,13 +36,21 @@ typedef struct Stats StatsT;
 
 const static StatsT init_stats_value = { 0 };
 
+size_t statsbytes () {
+    return arenabytes (sizeof(StatsT));
+}
+
 // call at start
-StatsT * init_stats () {
-    StatsT * newstats = malloc (sizeof(StatsT));
+StatsT * init_stats (ArenaT *arena) {
+    StatsT * newstats = arenaalloc (arena, sizeof(StatsT));
     *newstats = init_stats_value;
     return newstats;
 }
 
+void reset_stats (StatsT * stats) {
+    *stats = init_stats_value;
+}
+
 
 // increase instruction count
 void incrIcount (StatsT * stats) {
@@ -76,6 +84,21 @@ void incrDWcost (StatsT * stats, ELAPSED cost) {
 }
 
 
+// increase instruction count by more than 1
+void addIcount (StatsT * stats, ELAPSED count) {
+    stats->instructions += count;
+}
+
+// increase data read count by more than 1
+void addDRcount (StatsT * stats, ELAPSED count) {
+    stats->datareads += count;
+}
+
+// increase data write count by more than 1
+void addDWcount (StatsT * stats, ELAPSED count) {
+    stats->datawrites += count;
+}
+
 ELAPSED getIcount (StatsT * stats) {
     return stats->instructions;
 }
@@ -89,10 +112,3 @@ ELAPSED getDWcount (StatsT * stats) {
     return stats->datawrites;
 }
 
-
-// call at the end to dispose data structure
-// need extra pointer layer to dispose and reset pointer to NULL
-void deconstruct_stats (StatsT ** stats) {
-    free (*stats);
-    *stats = NULL;
-}
@@ -0,0 +1,344 @@
+/*
+ * tlb.c
+ *
+ * Address translation in front of a cache hierarchy: first-level instruction
+ * and data TLBs, a shared second-level TLB and the page table behind them.
+ * A TLB entry only needs the virtual page number: the frame it maps to never
+ * changes once allocated, so is kept in the page table rather than in the TLB.
+ *
+ */
+
+#include "tlb.h"
+#include "error.h"
+
+#include <stdlib.h> // malloc
+#include <stdio.h>
+#include <stdint.h> // 64-bit arithmetic on addresses above 4GiB
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+typedef unsigned Bitshift;
+
+// x86-64 style page table: 9 bits of virtual address per level, 8-byte entries
+#define TABLEBITS  9
+#define PTESIZE    8
+#define TABLESIZE  ((1u<<TABLEBITS)*PTESIZE)
+#define TOPSHIFT   39   // lowest virtual address bit indexing the top-level table
+#define ADDRESSBITS 32  // bits in AddressT
+
+typedef struct {
+    AddressT *entries;   // virtual page number + 1 for each way of each set; 0 if empty
+    CachesizeT sets;     // any number: TLBs are often e.g. 1536 entries, 12-way
+    CacheAssociativityT associativity;
+    LatencyT hittime;
+    StatsT *hitcount,
+           *misscount,
+           *lookupcost;
+} TLBT;
+
+struct TLBs {
+    TLBT *tlb [NTLBKINDS];      // NULL if absent
+    PagesizeT pagesize;
+    Bitshift pagebits;
+    int walklevels;             // page table levels read in a walk
+    AddressT *frames;           // for each virtual page, physical frame + 1; 0 if none
+    AddressT *tables [MAXWALK]; // for each level, physical address of each table; 0 if none
+    // allocators: pages go up from the first page above 0, page tables down from the
+    // top of physical memory; physical addresses wrap if more than 4GiB is touched
+    uint64_t nextframe,
+             nexttable;
+    StatsT *walkcount,
+           *walkcost;
+    RandomT *random;            // replacement choices, from the hierarchy's seed
+}; // typedef TLBsT
+
+
+//////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
+
+static TLBT* inittlb (CachesizeT entries, CacheAssociativityT associativity,
+                      LatencyT hittime, ArenaT *arena);
+
+static size_t tlbbytes (CachesizeT entries);
+
+static bool anytlb (CacheSetupT *firstlevel);
+
+static Bitshift pagebitsfor (PagesizeT pagesize);
+
+// page table levels read in a walk: each translates TABLEBITS more bits, so
+// 4KiB pages need all 4
+static int walklevelsfor (Bitshift pagebits);
+
+// entries in each table of a level: one for every value of the address bits above
+// those it translates
+static size_t tableentries (int level);
+
+// look up a virtual page in one TLB, counting a hit or miss and the lookup time
+static bool tlbprobe (TLBT* tlb, AddressT page, ReftypeT reftype);
+
+// put a virtual page in one TLB: in an empty way if its set has one, otherwise a
+// random one
+static void tlbinsert (TLBT* tlb, AddressT page, RandomT *random);
+
+static AddressT tophysical (TLBsT* tlbs, AddressT virtual);
+
+static void incrcount (StatsT *stats, ReftypeT reftype);
+static void incrcost (StatsT *stats, ReftypeT reftype, ELAPSED cost);
+
+static ELAPSED sumstats (StatsT *stats);
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+TLBsT* inittlbs (CacheSetupT *firstlevel, RandomT *random, ArenaT *arena) {
+    if (!anytlb (firstlevel))
+        return NULL;
+    TLBsT *tlbs = arenaalloc (arena, sizeof (TLBsT));
+    tlbs->pagesize = getSetupPagesize (firstlevel);
+    for (int i = 0; i < NTLBKINDS; i++)
+        tlbs->tlb[i] = getSetupTLBentries (firstlevel, i) ?
+            inittlb (getSetupTLBentries (firstlevel, i),
+                     getSetupTLBassociativity (firstlevel, i),
+                     getSetupTLBhittime (firstlevel, i), arena) : NULL;
+    tlbs->pagebits = pagebitsfor (tlbs->pagesize);
+    tlbs->walklevels = walklevelsfor (tlbs->pagebits);
+    // zeroed by the arena: no frames or tables yet
+    tlbs->frames = arenaalloc (arena, sizeof (AddressT) << (ADDRESSBITS - tlbs->pagebits));
+    for (int level = 0; level < tlbs->walklevels; level++)
+        tlbs->tables[level] = arenaalloc (arena, sizeof (AddressT) * tableentries (level));
+    tlbs->nextframe = tlbs->pagesize; // leave frame 0 unused, as a null page
+    tlbs->nexttable = (uint64_t) 1 << ADDRESSBITS;
+    tlbs->walkcount = init_stats (arena);
+    tlbs->walkcost = init_stats (arena);
+    tlbs->random = random;
+    return tlbs;
+}
+
+size_t tlbsbytes (CacheSetupT *firstlevel) {
+    if (!anytlb (firstlevel))
+        return 0;
+    size_t bytes = arenabytes (sizeof (TLBsT)) + 2*statsbytes ();
+    for (int i = 0; i < NTLBKINDS; i++)
+        if (getSetupTLBentries (firstlevel, i))
+            bytes += tlbbytes (getSetupTLBentries (firstlevel, i));
+    Bitshift pagebits = pagebitsfor (getSetupPagesize (firstlevel));
+    bytes += arenabytes (sizeof (AddressT) << (ADDRESSBITS - pagebits));
+    for (int level = 0; level < walklevelsfor (pagebits); level++)
+        bytes += arenabytes (sizeof (AddressT) * tableentries (level));
+    return bytes;
+}
+
+void flushtlbs (TLBsT* tlbs) {
+    flushtlbentries (tlbs);
+    arenazero (tlbs->frames, sizeof (AddressT) << (ADDRESSBITS - tlbs->pagebits));
+    for (int level = 0; level < tlbs->walklevels; level++)
+        arenazero (tlbs->tables[level], sizeof (AddressT) * tableentries (level));
+    tlbs->nextframe = tlbs->pagesize;
+    tlbs->nexttable = (uint64_t) 1 << ADDRESSBITS;
+}
+
+void flushtlbentries (TLBsT* tlbs) {
+    for (int i = 0; i < NTLBKINDS; i++)
+        if (tlbs->tlb[i])
+            arenazero (tlbs->tlb[i]->entries,
+                       tlbs->tlb[i]->sets*tlbs->tlb[i]->associativity*sizeof (AddressT));
+}
+
+void resettlbstats (TLBsT* tlbs) {
+    for (int i = 0; i < NTLBKINDS; i++)
+        if (tlbs->tlb[i]) {
+            reset_stats (tlbs->tlb[i]->hitcount);
+            reset_stats (tlbs->tlb[i]->misscount);
+            reset_stats (tlbs->tlb[i]->lookupcost);
+        }
+    reset_stats (tlbs->walkcount);
+    reset_stats (tlbs->walkcost);
+}
+
+bool tlbLookup (TLBsT* tlbs, AddressT virtual, ReftypeT reftype, AddressT *physical) {
+    TLBT *first = tlbs->tlb[reftype == FETCH ? ITLB : DTLB];
+    AddressT page = virtual >> tlbs->pagebits;
+    if (first && tlbprobe (first, page, reftype)) {
+        *physical = tophysical (tlbs, virtual);
+        return true;
+    }
+    if (tlbs->tlb[STLB] && tlbprobe (tlbs->tlb[STLB], page, reftype)) {
+        if (first)
+            tlbinsert (first, page, tlbs->random);
+        *physical = tophysical (tlbs, virtual);
+        return true;
+    }
+    return false;
+}
+
+int tlbWalk (TLBsT* tlbs, AddressT virtual, AddressT ptes[MAXWALK]) {
+    AddressT *frame = &tlbs->frames[virtual >> tlbs->pagebits];
+    if (!*frame) {
+        *frame = (AddressT) (tlbs->nextframe >> tlbs->pagebits) + 1;
+        tlbs->nextframe += tlbs->pagesize;
+    }
+    for (int level = 0; level < tlbs->walklevels; level++) {
+        Bitshift shift = TOPSHIFT - level*TABLEBITS;
+        AddressT *table = &tlbs->tables[level][(uint64_t) virtual >> (shift + TABLEBITS)];
+        if (!*table) {
+            tlbs->nexttable -= TABLESIZE;
+            *table = (AddressT) tlbs->nexttable;
+        }
+        ptes[level] = *table + (((uint64_t) virtual >> shift) & ((1u<<TABLEBITS)-1))*PTESIZE;
+    }
+    return tlbs->walklevels;
+}
+
+AddressT tlbFill (TLBsT* tlbs, AddressT virtual, ReftypeT reftype, ELAPSED walkcost) {
+    TLBT *first = tlbs->tlb[reftype == FETCH ? ITLB : DTLB];
+    AddressT page = virtual >> tlbs->pagebits;
+    if (tlbs->tlb[STLB])
+        tlbinsert (tlbs->tlb[STLB], page, tlbs->random);
+    if (first)
+        tlbinsert (first, page, tlbs->random);
+    incrcount (tlbs->walkcount, reftype);
+    incrcost (tlbs->walkcost, reftype, walkcost);
+    return tophysical (tlbs, virtual);
+}
+
+ELAPSED reporttlbs (TLBsT* tlbs) {
+    static const char *names [] = {"ITLB", "DTLB", "STLB"}; // in the order of TLBkindT
+    ELAPSED totallookups = 0;
+    printf ("TLB\tHits\tmisses\tlook t\n");
+    for (int i = 0; i < NTLBKINDS; i++) {
+        TLBT *tlb = tlbs->tlb[i];
+        if (!tlb)
+            continue;
+        printf ("$[%s]\t%lu\t%lu\t%lu\n", names[i], sumstats (tlb->hitcount),
+                sumstats (tlb->misscount), sumstats (tlb->lookupcost));
+        totallookups += sumstats (tlb->lookupcost);
+    }
+    printf ("Page walks %lu (I %lu, DR %lu, DW %lu), walk time %lu (in the cache levels' times)\n",
+            sumstats (tlbs->walkcount), getIcount (tlbs->walkcount),
+            getDRcount (tlbs->walkcount), getDWcount (tlbs->walkcount),
+            sumstats (tlbs->walkcost));
+    return totallookups;
+}
+
+
+void reporttlbsto (TLBsT* tlbs, ReportT *report, ELAPSED lookuptime [3]) {
+    static const char *names [] = {"ITLB", "DTLB", "STLB"}, // in the order of TLBkindT
+                      *types [] = {"I", "DR", "DW"};
+    ELAPSED (*get [])(StatsT *) = {getIcount, getDRcount, getDWcount};
+    for (int i = 0; i < NTLBKINDS; i++) {
+        TLBT *tlb = tlbs->tlb[i];
+        if (!tlb)
+            continue;
+        for (int type = 0; type < 3; type++) {
+            reportcount (report, names[i], types[type], "hits", get[type] (tlb->hitcount));
+            reportcount (report, names[i], types[type], "misses", get[type] (tlb->misscount));
+            reportcount (report, names[i], types[type], "lookuptime",
+                         get[type] (tlb->lookupcost));
+            lookuptime[type] += get[type] (tlb->lookupcost);
+        }
+        reportcount (report, names[i], "", "hits", sumstats (tlb->hitcount));
+        reportcount (report, names[i], "", "misses", sumstats (tlb->misscount));
+        reportcount (report, names[i], "", "lookuptime", sumstats (tlb->lookupcost));
+    }
+    for (int type = 0; type < 3; type++) {
+        reportcount (report, "walks", types[type], "walks", get[type] (tlbs->walkcount));
+        reportcount (report, "walks", types[type], "walktime", get[type] (tlbs->walkcost));
+    }
+    reportcount (report, "walks", "", "walks", sumstats (tlbs->walkcount));
+    reportcount (report, "walks", "", "walktime", sumstats (tlbs->walkcost));
+}
+
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+static TLBT* inittlb (CachesizeT entries, CacheAssociativityT associativity,
+                      LatencyT hittime, ArenaT *arena) {
+    TLBT *tlb = arenaalloc (arena, sizeof (TLBT));
+    tlb->entries = arenaalloc (arena, entries * sizeof (AddressT)); // zeroed: all empty
+    tlb->sets = entries/associativity;
+    tlb->associativity = associativity;
+    tlb->hittime = hittime;
+    tlb->hitcount = init_stats (arena);
+    tlb->misscount = init_stats (arena);
+    tlb->lookupcost = init_stats (arena);
+    return tlb;
+}
+
+static size_t tlbbytes (CachesizeT entries) {
+    return arenabytes (sizeof (TLBT)) + arenabytes (entries * sizeof (AddressT)) +
+           3*statsbytes ();
+}
+
+static bool anytlb (CacheSetupT *firstlevel) {
+    for (int i = 0; i < NTLBKINDS; i++)
+        if (getSetupTLBentries (firstlevel, i))
+            return true;
+    return false;
+}
+
+static Bitshift pagebitsfor (PagesizeT pagesize) {
+    Bitshift pagebits = 0;
+    while ((1u << pagebits) < pagesize)
+        pagebits++;
+    return pagebits;
+}
+
+static int walklevelsfor (Bitshift pagebits) {
+    return MAXWALK - (pagebits - 12) / TABLEBITS;
+}
+
+static size_t tableentries (int level) {
+    int tablebits = ADDRESSBITS - (TOPSHIFT + TABLEBITS - level*TABLEBITS);
+    return (size_t) 1 << (tablebits > 0 ? tablebits : 0);
+}
+
+static bool tlbprobe (TLBT* tlb, AddressT page, ReftypeT reftype) {
+    AddressT *set = &tlb->entries[(page % tlb->sets)*tlb->associativity];
+    incrcost (tlb->lookupcost, reftype, tlb->hittime);
+    for (int i = 0; i < tlb->associativity; i++)
+        if (set[i] == page + 1) {
+            incrcount (tlb->hitcount, reftype);
+            return true;
+        }
+    incrcount (tlb->misscount, reftype);
+    return false;
+}
+
+static void tlbinsert (TLBT* tlb, AddressT page, RandomT *random) {
+    AddressT *set = &tlb->entries[(page % tlb->sets)*tlb->associativity];
+    CacheAssociativityT way;
+    for (way = 0; way < tlb->associativity; way++)
+        if (!set[way])
+            break;
+    if (way == tlb->associativity)
+        way = randombelow (random, tlb->associativity);
+    set[way] = page + 1;
+}
+
+static AddressT tophysical (TLBsT* tlbs, AddressT virtual) {
+    AddressT frame = tlbs->frames[virtual >> tlbs->pagebits] - 1;
+    return (frame << tlbs->pagebits) | (virtual & (tlbs->pagesize - 1));
+}
+
+static void incrcount (StatsT *stats, ReftypeT reftype) {
+    if (reftype == FETCH)
+        incrIcount (stats);
+    else if (reftype == READ)
+        incrDRcount (stats);
+    else
+        incrDWcount (stats);
+}
+
+static void incrcost (StatsT *stats, ReftypeT reftype, ELAPSED cost) {
+    if (reftype == FETCH)
+        incrIcost (stats, cost);
+    else if (reftype == READ)
+        incrDRcost (stats, cost);
+    else
+        incrDWcost (stats, cost);
+}
+
+static ELAPSED sumstats (StatsT *stats) {
+    return getIcount (stats) + getDRcount (stats) + getDWcount (stats);
+}
@@ -0,0 +1,95 @@
+/* Convert a text trace to the delta format of deltatrace.h
+ *   traceconvert textfile deltafile
+ * The text trace may be compressed as for the simulator (see tracefile.h). The
+ * delta trace collapses constant-stride runs of the same type of reference, e.g.
+ * straight-line instruction fetches, which the simulator can then handle in
+ * bulk, and is read by the simulator in place of the text trace: it is
+ * recognised by its magic number, not the file name.
+ *
+ * The trace is read as the simulator reads it (readtrace.h), so a tool's trace
+ * converts too, but the delta format has no access sizes: a trace with them
+ * is rejected, as it would simulate differently once converted. A record of
+ * no known type ends the trace, as in the simulator.
+ *
+ * The delta trace is written to deltafile.partial and only renamed to deltafile
+ * once it is complete, so a conversion that fails (errors exit from anywhere,
+ * including the reader thread) leaves neither a partial trace, which the
+ * simulator would read as a short one, nor a damaged earlier deltafile.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "deltatrace.h"
+#include "readtrace.h"
+#include "tracefile.h"
+#include "error.h"
+
+#define PARTIALSUFFIX ".partial"
+
+// the output until renamed: removed on exit if set
+static char *partialname = NULL;
+
+static void removepartial () {
+    if (partialname)
+        remove (partialname);
+}
+
+
+int main (int argc, char *argv []) {
+    if (argc != 3) {
+        fprintf (stderr, "usage: %s textfile deltafile\n", argv[0]);
+        exit (1);
+    }
+    FILE *text = opentracefile (argv[1]);
+    if (!text)
+        error (workloadError, false, "Text trace file not openable", __LINE__, __FILE__);
+    partialname = malloc (strlen (argv[2]) + sizeof (PARTIALSUFFIX));
+    if (!partialname)
+        error (memoryError, false, "output file name", __LINE__, __FILE__);
+    strcat (strcpy (partialname, argv[2]), PARTIALSUFFIX);
+    FILE *delta = fopen (partialname, "wb");
+    if (!delta)
+        error (traceError, false, partialname, __LINE__, __FILE__);
+    atexit (removepartial);
+    init_tracingfile (text);
+    DeltaEncoderT *encoder = initdeltaencoder (delta);
+    unsigned long Nrecords = 0;
+    bool ended = false;
+    while (!ended) {
+        int N;
+        const Trace *records = next_chunk (0, &N);
+        for (int i = 0; i < N && !ended; i++) {
+            Trace record = records[i];
+            if (record.reftype == EOFSYMBOL || !strchr ("IRWXBV", record.reftype)) {
+                if (record.reftype != EOFSYMBOL)
+                    fprintf (stderr, "stopped at a record of type `%c', which ends the trace\n",
+                             record.reftype);
+                ended = true;
+            } else if (record.size)
+                error (traceError, false, "has access sizes, which the delta format can't hold",
+                       __LINE__, __FILE__);
+            else {
+                // a run from a delta trace, a reference at a time: the encoder finds it again
+                for (unsigned j = 0; j < record.count; j++) {
+                    deltaencode (encoder, record);
+                    record.addr += record.stride;
+                }
+                Nrecords += record.count;
+            }
+        }
+    }
+    finishdeltaencoder (&encoder);
+    deconstruct_tracing ();
+    fclose (text);
+    long Nbytes = ftell (delta);
+    if (ferror (delta) | fclose (delta))
+        error (traceError, false, partialname, __LINE__, __FILE__);
+    if (rename (partialname, argv[2]))
+        error (traceError, false, argv[2], __LINE__, __FILE__);
+    free (partialname);
+    partialname = NULL;
+    fprintf (stderr, "%lu records in %ld bytes\n", Nrecords, Nbytes);
+}
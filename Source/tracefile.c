@@ -0,0 +1,412 @@
+/*
+ * tracefile.c
+ *
+ * Open a trace file, decompressing it on the fly if compressed. A compressed
+ * file is wrapped in a stdio stream with fopencookie, so the rest of the
+ * simulator reads it like any other file.
+ *
+ * The LZ4 frame format is decoded here rather than with liblz4: blocks are up
+ * to 4MiB and, if the frame says they are independent, a batch of them is
+ * decoded at once with a thread per block. Linked blocks can refer back 64KiB
+ * into the previous block's output, so are decoded one at a time. Checksums
+ * are skipped rather than verified; dictionaries are not supported.
+ *
+ * A compressed trace that is corrupt or cut short is a fatal error rather than
+ * the end of the trace, so a damaged file can't pass for a short trace.
+ *
+ */
+
+#define _GNU_SOURCE // fopencookie
+
+#include "tracefile.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>  // sysconf
+#include <pthread.h>
+#include <zlib.h>
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+#define GZIPMAGIC        0x8b1f       // first 2 bytes, little-endian
+#define LZ4MAGIC         0x184D2204
+#define LZ4SKIPPABLE     0x184D2A50   // to 0x184D2A5F: skippable frames
+#define LZ4SKIPPABLEMASK 0xFFFFFFF0
+#define ZSTDMAGIC        0xFD2FB528
+
+#define LZ4WINDOW        (64*1024)    // how far back a match can reach
+#define LZ4STOREDBIT     0x80000000u  // block size flag: block is not compressed
+#define MAXBATCH         8            // independent blocks decoded at once
+
+#define GZBUFFERSIZE     (256*1024)
+
+typedef struct {
+    unsigned char *in,
+                  *out;
+    size_t inlength,
+           outlength;
+    bool stored;       // not compressed: copy as is
+    size_t outstart;   // history before this in out that matches may refer to
+    bool bad;          // corrupt block
+} Lz4blockT;
+
+typedef struct {
+    FILE *file;
+    size_t blockmax;
+    bool inframe,        // between a frame header and its end mark
+         atend,          // no more frames
+         independent,    // blocks don't refer to earlier blocks' output
+         blockchecksums,
+         contentchecksum;
+    int Nworkers,        // blocks decoded at once if independent
+        Nbatch,          // blocks in the batch decoded
+        nextblock;       // next one to return output from
+    size_t nextbyte;     // within that block's output
+    Lz4blockT batch [MAXBATCH];
+    size_t history;      // linked blocks: bytes of earlier output kept in batch[0].out
+} Lz4streamT;
+
+static unsigned Nthreads = 0; // most decoding threads: 0 for one per processor
+
+
+//////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
+
+static FILE *opengzip (const char *filename);
+
+static FILE *openlz4 (FILE *file);
+
+// fopencookie functions
+static ssize_t gzipread (void *cookie, char *buffer, size_t size);
+static int gzipclose (void *cookie);
+static ssize_t lz4read (void *cookie, char *buffer, size_t size);
+static int lz4close (void *cookie);
+
+// read the next frame header, skipping skippable frames; false at the end
+// of the file (a bad or cut short header is fatal)
+static bool lz4frameheader (Lz4streamT *stream);
+
+// read and decode the next block or, if independent, batch of blocks; false if
+// there are none left (a frame cut short is fatal)
+static bool lz4nextbatch (Lz4streamT *stream);
+
+// decode a block: thread function, so takes and returns void*
+static void *lz4decodeblock (void *block);
+
+// decode an LZ4 block of inlength bytes into out, starting at outstart with
+// earlier output before that; number of bytes decoded, or -1 if corrupt
+static long lz4decompress (const unsigned char *in, size_t inlength,
+                           unsigned char *out, size_t outstart, size_t outcapacity);
+
+static uint32_t read32 (const unsigned char *bytes);
+
+// skip bytes in a file that may not support seeking
+static bool skipbytes (FILE *file, size_t count);
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+void settracethreads (unsigned threads) {
+    Nthreads = threads;
+}
+
+FILE *opentracefile (const char *filename) {
+    FILE *file = fopen (filename, "r");
+    if (!file)
+        return NULL;
+    unsigned char magic [4] = {0, 0, 0, 0};
+    size_t got = fread (magic, 1, sizeof (magic), file);
+    rewind (file);
+    if (got >= 2 && (magic[0] | magic[1] << 8) == GZIPMAGIC) {
+        fclose (file);
+        return opengzip (filename);
+    }
+    if (got == 4 && read32 (magic) == LZ4MAGIC)
+        return openlz4 (file);
+    if (got == 4 && read32 (magic) == ZSTDMAGIC) {
+        fprintf (stderr, "ERROR: `%s' is zstd compressed, which isn't supported: "
+                 "use gzip or LZ4\n", filename);
+        fclose (file);
+        errno = EINVAL;
+        return NULL;
+    }
+    return file;
+}
+
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+static FILE *opengzip (const char *filename) {
+    gzFile gzip = gzopen (filename, "rb");
+    if (!gzip)
+        return NULL;
+    gzbuffer (gzip, GZBUFFERSIZE);
+    cookie_io_functions_t functions = {gzipread, NULL, NULL, gzipclose};
+    return fopencookie (gzip, "r", functions);
+}
+
+static ssize_t gzipread (void *cookie, char *buffer, size_t size) {
+    int got = gzread ((gzFile) cookie, buffer, size), status;
+    if (got < 0)
+        error (traceError, false, "corrupt gzip trace", __LINE__, __FILE__);
+    // at the end of the file, zlib reports a stream cut short as Z_BUF_ERROR
+    if (!got && (gzerror ((gzFile) cookie, &status), status != Z_OK))
+        error (traceError, false, "gzip trace cut short", __LINE__, __FILE__);
+    return got;
+}
+
+static int gzipclose (void *cookie) {
+    int status = gzclose ((gzFile) cookie);
+    if (status == Z_BUF_ERROR)
+        error (traceError, false, "gzip trace cut short", __LINE__, __FILE__);
+    return status == Z_OK ? 0 : EOF;
+}
+
+static FILE *openlz4 (FILE *file) {
+    Lz4streamT *stream = calloc (1, sizeof (Lz4streamT));
+    if (!stream)
+        error (memoryError, false, "LZ4 stream", __LINE__, __FILE__);
+    stream->file = file;
+    long processors = Nthreads ? Nthreads : sysconf (_SC_NPROCESSORS_ONLN);
+    stream->Nworkers = processors < 1 ? 1 : (processors > MAXBATCH ? MAXBATCH : processors);
+    cookie_io_functions_t functions = {lz4read, NULL, NULL, lz4close};
+    return fopencookie (stream, "r", functions);
+}
+
+static ssize_t lz4read (void *cookie, char *buffer, size_t size) {
+    Lz4streamT *stream = cookie;
+    size_t copied = 0;
+    while (copied < size) {
+        if (stream->nextblock == stream->Nbatch && !lz4nextbatch (stream))
+            break;
+        Lz4blockT *block = &stream->batch[stream->nextblock];
+        if (block->bad)
+            error (traceError, false, "corrupt LZ4 trace", __LINE__, __FILE__);
+        size_t available = block->outlength - stream->nextbyte,
+               count = available < size - copied ? available : size - copied;
+        memcpy (buffer + copied, block->out + block->outstart + stream->nextbyte, count);
+        copied += count;
+        stream->nextbyte += count;
+        if (stream->nextbyte == block->outlength) {
+            stream->nextblock++;
+            stream->nextbyte = 0;
+        }
+    }
+    return copied;
+}
+
+static int lz4close (void *cookie) {
+    Lz4streamT *stream = cookie;
+    for (int i = 0; i < MAXBATCH; i++) {
+        free (stream->batch[i].in);
+        free (stream->batch[i].out);
+    }
+    int result = fclose (stream->file);
+    free (stream);
+    return result;
+}
+
+static bool lz4frameheader (Lz4streamT *stream) {
+    unsigned char header [4];
+    while (true) {
+        size_t got = fread (header, 1, 4, stream->file);
+        if (!got && feof (stream->file))
+            return false; // the end of the last frame was the end of the file
+        if (got != 4)
+            error (traceError, false, "LZ4 trace cut short", __LINE__, __FILE__);
+        uint32_t magic = read32 (header);
+        if ((magic & LZ4SKIPPABLEMASK) == LZ4SKIPPABLE) {
+            if (fread (header, 1, 4, stream->file) != 4 ||
+                !skipbytes (stream->file, read32 (header)))
+                error (traceError, false, "LZ4 trace cut short", __LINE__, __FILE__);
+            continue;
+        }
+        if (magic != LZ4MAGIC)
+            error (traceError, false, "corrupt LZ4 trace: bad frame magic number",
+                   __LINE__, __FILE__);
+        break;
+    }
+    // FLG: version 01, block independence, block checksum, content size,
+    // content checksum, reserved, dictionary ID; BD: maximum block size
+    if (fread (header, 1, 2, stream->file) != 2)
+        error (traceError, false, "LZ4 trace cut short", __LINE__, __FILE__);
+    unsigned char flags = header[0], blockdescriptor = header[1];
+    int blocksizeid = (blockdescriptor >> 4) & 7;
+    if ((flags >> 6) != 1 || (flags & 1) || blocksizeid < 4)
+        error (traceError, false, "unsupported LZ4 frame", __LINE__, __FILE__);
+    size_t blockmax = (size_t) 1 << (8 + 2*blocksizeid); // 4: 64KiB ... 7: 4MiB
+    stream->independent = flags & 0x20;
+    stream->blockchecksums = flags & 0x10;
+    stream->contentchecksum = flags & 0x04;
+    // skip the content size if present and the header checksum
+    if (!skipbytes (stream->file, ((flags & 0x08) ? 8 : 0) + 1))
+        error (traceError, false, "LZ4 trace cut short", __LINE__, __FILE__);
+    if (blockmax > stream->blockmax) {
+        stream->blockmax = blockmax;
+        for (int i = 0; i < MAXBATCH; i++) {
+            free (stream->batch[i].in);
+            free (stream->batch[i].out);
+            stream->batch[i].in = malloc (blockmax);
+            stream->batch[i].out = malloc (LZ4WINDOW + blockmax);
+            if (!stream->batch[i].in || !stream->batch[i].out)
+                error (memoryError, false, "LZ4 blocks", __LINE__, __FILE__);
+        }
+    }
+    stream->history = 0;
+    stream->inframe = true;
+    return true;
+}
+
+static bool lz4nextbatch (Lz4streamT *stream) {
+    stream->Nbatch = stream->nextblock = 0;
+    stream->nextbyte = 0;
+    // linked blocks: keep the end of the last block's output as history
+    if (stream->inframe && !stream->independent) {
+        Lz4blockT *last = &stream->batch[0];
+        size_t total = last->outstart + last->outlength,
+               keep = total < LZ4WINDOW ? total : LZ4WINDOW;
+        memmove (last->out, last->out + total - keep, keep);
+        stream->history = keep;
+    }
+    while (!stream->atend && stream->Nbatch < (stream->independent ? stream->Nworkers : 1)) {
+        if (!stream->inframe && !lz4frameheader (stream)) {
+            stream->atend = true;
+            break;
+        }
+        unsigned char sizebytes [4];
+        if (fread (sizebytes, 1, 4, stream->file) != 4)
+            error (traceError, false, "LZ4 trace cut short", __LINE__, __FILE__);
+        uint32_t size = read32 (sizebytes);
+        if (!size) { // end mark: a new frame may follow, so finish this batch
+            stream->inframe = false;
+            if (stream->contentchecksum && !skipbytes (stream->file, 4))
+                error (traceError, false, "LZ4 trace cut short", __LINE__, __FILE__);
+            if (stream->Nbatch)
+                break;
+            continue;
+        }
+        Lz4blockT *block = &stream->batch[stream->Nbatch++];
+        block->stored = size & LZ4STOREDBIT;
+        block->inlength = size & ~LZ4STOREDBIT;
+        block->outstart = stream->independent ? 0 : stream->history;
+        block->outlength = LZ4WINDOW + stream->blockmax; // capacity until decoded
+        if (block->inlength > stream->blockmax)
+            error (traceError, false, "corrupt LZ4 trace: block too big", __LINE__, __FILE__);
+        if (fread (block->in, 1, block->inlength, stream->file) != block->inlength ||
+            (stream->blockchecksums && !skipbytes (stream->file, 4)))
+            error (traceError, false, "LZ4 trace cut short", __LINE__, __FILE__);
+        block->bad = false;
+    }
+    if (!stream->Nbatch)
+        return false;
+    // decode the first block here, the rest in a thread each
+    pthread_t workers [MAXBATCH];
+    bool started [MAXBATCH];
+    for (int i = 1; i < stream->Nbatch; i++)
+        started[i] = !pthread_create (&workers[i], NULL, lz4decodeblock, &stream->batch[i]);
+    lz4decodeblock (&stream->batch[0]);
+    for (int i = 1; i < stream->Nbatch; i++)
+        if (started[i])
+            pthread_join (workers[i], NULL);
+        else
+            lz4decodeblock (&stream->batch[i]);
+    return true;
+}
+
+static void *lz4decodeblock (void *lz4block) {
+    Lz4blockT *block = lz4block;
+    if (block->bad)
+        return NULL;
+    size_t capacity = block->outlength;
+    if (block->stored) {
+        if (block->inlength > capacity - block->outstart) {
+            block->bad = true;
+            return NULL;
+        }
+        memcpy (block->out + block->outstart, block->in, block->inlength);
+        block->outlength = block->inlength;
+    } else {
+        long decoded = lz4decompress (block->in, block->inlength, block->out,
+                                      block->outstart, capacity);
+        block->bad = decoded < 0;
+        block->outlength = decoded < 0 ? 0 : decoded;
+    }
+    return NULL;
+}
+
+// a block is a series of sequences, each a token (high 4 bits literal length,
+// low 4 bits match length - 4, 15 meaning more length bytes follow), literals,
+// then a 2-byte offset back into the output and the match; the last sequence
+// has only literals
+static long lz4decompress (const unsigned char *in, size_t inlength,
+                           unsigned char *out, size_t outstart, size_t outcapacity) {
+    const unsigned char *ip = in, *inend = in + inlength;
+    unsigned char *op = out + outstart, *outend = out + outcapacity;
+    while (ip < inend) {
+        unsigned token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            unsigned char more;
+            do {
+                if (ip == inend)
+                    return -1;
+                more = *ip++;
+                literals += more;
+            } while (more == 255);
+        }
+        if (literals > (size_t) (inend - ip) || literals > (size_t) (outend - op))
+            return -1;
+        memcpy (op, ip, literals);
+        op += literals;
+        ip += literals;
+        if (ip == inend)
+            break; // last sequence
+        if (inend - ip < 2)
+            return -1;
+        size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (!offset || offset > (size_t) (op - out))
+            return -1;
+        size_t matchlength = (token & 15) + 4;
+        if ((token & 15) == 15) {
+            unsigned char more;
+            do {
+                if (ip == inend)
+                    return -1;
+                more = *ip++;
+                matchlength += more;
+            } while (more == 255);
+        }
+        if (matchlength > (size_t) (outend - op))
+            return -1;
+        const unsigned char *match = op - offset;
+        if (offset >= matchlength) {
+            memcpy (op, match, matchlength);
+            op += matchlength;
+        } else { // overlapping: repeats the last offset bytes
+            while (matchlength--)
+                *op++ = *match++;
+        }
+    }
+    return op - (out + outstart);
+}
+
+static uint32_t read32 (const unsigned char *bytes) {
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static bool skipbytes (FILE *file, size_t count) {
+    unsigned char discard [256];
+    while (count) {
+        size_t chunk = count < sizeof (discard) ? count : sizeof (discard);
+        if (fread (discard, 1, chunk, file) != chunk)
+            return false;
+        count -= chunk;
+    }
+    return true;
+}
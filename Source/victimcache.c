@@ -0,0 +1,197 @@
+/*
+ * victimcache.c
+ *
+ * A small fully-associative buffer of blocks evicted from a cache level.
+ * Lookups go through a hash index on the block address rather than a scan of
+ * every entry, so they cost the same however many entries there are. When
+ * full, the least recently added block is pushed out; since a hit takes the
+ * block out again (it is swapped back into the cache level it came from), that
+ * is also the least recently used one. No timing: that is up to the level
+ * the victim cache is attached to.
+ *
+ */
+
+#include "victimcache.h"
+#include "error.h"
+
+#include <stdlib.h> // malloc
+
+/////////////////////////////////////// LOCAL TYPES //////////////////////////////////////
+//////////////////////////////// DETAIL HIDDEN FROM HEADER ///////////////////////////////
+
+typedef unsigned Bitshift;
+
+// entries are linked by array index; NOENTRY ends a list
+#define NOENTRY (-1)
+
+typedef struct {
+    AddressT block;  // address with offset bits shifted out
+    TagT tags;
+    int hashnext,    // next entry in the same hash bucket
+        older,       // next older entry (towards the one pushed out next)
+        newer;       // next newer entry
+} VictimEntryT;
+
+struct VictimCache {
+    CachesizeT Nblocks,
+               Nused;
+    BlocksizeT blocksize;
+    Bitshift offsetbits;
+    VictimEntryT *entries;
+    int *buckets;        // hash index: first entry for each hash value
+    Bitshift bucketbits; // 2^bucketbits buckets, at least 2 per entry
+    int oldest, newest,  // ends of the age list
+        free;            // unused entries, linked through hashnext
+}; // typedef VictimCacheT
+
+
+//////////////////////////////////// STATIC PROTOTYPES ///////////////////////////////////
+
+static AddressT hashblock (VictimCacheT* cache, AddressT block);
+
+// bits of the hash index for a number of blocks: at least 2 buckets per block
+static Bitshift bucketbitsfor (CachesizeT blocks);
+
+// find the entry holding a block, or NOENTRY
+static int findentry (VictimCacheT* cache, AddressT block);
+
+// unlink an entry from its hash bucket and the age list and put it on the free list
+static void removeentry (VictimCacheT* cache, int entry);
+
+
+//////////////////////////////////// GLOBAL FUNCTIONS ////////////////////////////////////
+//////////////////////////////////// VISIBLE IN HEADER ///////////////////////////////////
+
+size_t victimcachebytes (CachesizeT blocks) {
+    return arenabytes (sizeof (VictimCacheT)) + arenabytes (sizeof (VictimEntryT)*blocks) +
+           arenabytes (sizeof (int) << bucketbitsfor (blocks));
+}
+
+VictimCacheT* initvictimcache (CachesizeT blocks, BlocksizeT blocksize, ArenaT *arena) {
+    if (!blocks)
+        error (badblockcount, false, "Victim cache needs at least one block", __LINE__, __FILE__);
+    if (!checkPowerof2 (blocksize))
+        error (badblockcount, false, "Block size must be a power of two", __LINE__, __FILE__);
+
+    VictimCacheT *newcache = arenaalloc (arena, sizeof (VictimCacheT));
+    newcache->bucketbits = bucketbitsfor (blocks);
+    CachesizeT Nbuckets = 1u << newcache->bucketbits;
+    newcache->Nblocks = blocks;
+    newcache->blocksize = blocksize;
+    newcache->offsetbits = 0;
+    while (blocksize >>= 1)
+        newcache->offsetbits++;
+    newcache->entries = arenaalloc (arena, sizeof (VictimEntryT)*blocks);
+    newcache->buckets = arenaalloc (arena, sizeof (int)*Nbuckets);
+    flushvictimcache (newcache);
+    return newcache;
+}
+
+void flushvictimcache (VictimCacheT* cache) {
+    CachesizeT Nbuckets = 1u << cache->bucketbits;
+    for (int i = 0; i < Nbuckets; i++)
+        cache->buckets[i] = NOENTRY;
+    // all entries start on the free list
+    for (int i = 0; i < cache->Nblocks; i++)
+        cache->entries[i].hashnext = (i+1 < cache->Nblocks)?i+1:NOENTRY;
+    cache->Nused = 0;
+    cache->free = 0;
+    cache->oldest = cache->newest = NOENTRY;
+}
+
+CachesizeT getVictimNblocks (VictimCacheT* cache) {
+    return cache->Nblocks;
+}
+
+bool victimHit (VictimCacheT* cache, AddressT where) {
+    return findentry (cache, where >> cache->offsetbits) != NOENTRY;
+}
+
+bool victimTake (VictimCacheT* cache, AddressT where, TagT *tags) {
+    int entry = findentry (cache, where >> cache->offsetbits);
+    if (entry == NOENTRY)
+        return false;
+    *tags = cache->entries[entry].tags;
+    removeentry (cache, entry);
+    return true;
+}
+
+bool victimPut (VictimCacheT* cache, AddressT where, TagT tags,
+                AddressT *pushedout, TagT *pushedtags) {
+    AddressT block = where >> cache->offsetbits;
+    bool pushed = false;
+    int entry = findentry (cache, block);
+    if (entry != NOENTRY) { // already here: start again as the newest, owned anew
+        tags |= cache->entries[entry].tags & ~OWNERMASK;
+        removeentry (cache, entry);
+    } else if (cache->Nused == cache->Nblocks) {
+        entry = cache->oldest;
+        *pushedout = cache->entries[entry].block << cache->offsetbits;
+        *pushedtags = cache->entries[entry].tags;
+        pushed = true;
+        removeentry (cache, entry);
+    }
+    // take an entry off the free list and make it the newest
+    entry = cache->free;
+    cache->free = cache->entries[entry].hashnext;
+    AddressT bucket = hashblock (cache, block);
+    VictimEntryT *newentry = &cache->entries[entry];
+    newentry->block = block;
+    newentry->tags = tags;
+    newentry->hashnext = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    newentry->newer = NOENTRY;
+    newentry->older = cache->newest;
+    if (cache->newest != NOENTRY)
+        cache->entries[cache->newest].newer = entry;
+    else
+        cache->oldest = entry;
+    cache->newest = entry;
+    cache->Nused++;
+    return pushed;
+}
+
+
+//////////////////////////////////// STATIC FUNCTIONS ////////////////////////////////////
+
+// multiplicative (Fibonacci) hash: spreads blocks that differ only in high
+// bits, as blocks evicted from the same set of a cache level do
+static AddressT hashblock (VictimCacheT* cache, AddressT block) {
+    return (block * 2654435761u) >> (32 - cache->bucketbits);
+}
+
+static Bitshift bucketbitsfor (CachesizeT blocks) {
+    Bitshift bits = 1;
+    while ((1u << bits) < blocks*2)
+        bits++;
+    return bits;
+}
+
+static int findentry (VictimCacheT* cache, AddressT block) {
+    int entry = cache->buckets[hashblock (cache, block)];
+    while (entry != NOENTRY && cache->entries[entry].block != block)
+        entry = cache->entries[entry].hashnext;
+    return entry;
+}
+
+static void removeentry (VictimCacheT* cache, int entry) {
+    VictimEntryT *oldentry = &cache->entries[entry];
+    // unlink from the hash bucket
+    int *link = &cache->buckets[hashblock (cache, oldentry->block)];
+    while (*link != entry)
+        link = &cache->entries[*link].hashnext;
+    *link = oldentry->hashnext;
+    // unlink from the age list
+    if (oldentry->older != NOENTRY)
+        cache->entries[oldentry->older].newer = oldentry->newer;
+    else
+        cache->oldest = oldentry->newer;
+    if (oldentry->newer != NOENTRY)
+        cache->entries[oldentry->newer].older = oldentry->older;
+    else
+        cache->newest = oldentry->older;
+    // onto the free list
+    oldentry->hashnext = cache->free;
+    cache->free = entry;
+    cache->Nused--;
+}
@@ -19,6 +19,7 @@
 #include <stdlib.h> // for malloc, free and exit
 #include <stdbool.h>
 #include "workload.h"
+#include "tracefile.h"
 // reinstate this if you need an instrumented version of malloc
 // #include "my_malloc.h" // breaks getline, since it calls malloc internally
 #define my_malloc malloc
@@ -72,7 +73,8 @@ static Workload* initworkload (char* filename) {
        filename[i] = '\0';                // adjust string end
        break;
     }
-  if (!(fp=fopen(filename, "r"))) {
+  // decompresses on the fly if compressed
+  if (!(fp=opentracefile(filename))) {
     fprintf(stderr,"ERROR: file `%s' can't be opened: ", filename);
     perror(NULL);
     return NULL;
@@ -133,9 +135,9 @@ PID getmaxPID () {
   return MAXPID;
 }
 
-// read file paths from stdin and check each exists; if any don't return false
+// read file paths from list and check each exists; if any don't return false
 // temporarily obscure my definitions of malloc and free so getline works OK
-bool init_workloads () {
+bool init_workloads (FILE *list) {
 #undef malloc
   char *line = malloc(sizeof(char)*(MAXNAME+2)); // al1ow 1 extra for each of \0 and \n 
 #define malloc my_malloc
@@ -143,7 +145,7 @@ bool init_workloads () {
   bool goodfile = false, badfile = false;
   // testing for EOF OK here because we either read a word or don't
   // hint for format that limits length and can read anything but new line
-  while (getline(&line, &lineN, stdin) != EOF) {
+  while (getline(&line, &lineN, list) != EOF) {
     //fixmax (line, MAXNAME);
     Workload * newworkload = initworkload (line);
     if (newworkload) { // if not we had a bad file path this time
@@ -183,6 +185,20 @@ void filedone (PID proc) {
   processes[proc]->process->more = false;
 }
 
+// reopened rather than rewound, as a decompressed stream can't seek
+bool rewind_workloads () {
+  for (WorkloadList *wl = workloads; wl; wl = wl->next) {
+    fclose (wl->process->fp);
+    if (!(wl->process->fp = opentracefile (wl->process->filepath))) {
+      fprintf(stderr,"ERROR: file `%s' can't be opened again: ", wl->process->filepath);
+      perror(NULL);
+      return false;
+    }
+    wl->process->more = true;
+  }
+  return true;
+}
+
 // call at termintation
 void deconstruct_workload () {
   WorkloadList * wl = workloads, *wl_prev=NULL;